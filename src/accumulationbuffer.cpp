@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "accumulationbuffer.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "constant.h"
+#include "output.h"
+#include "trifit.h"
+
+using namespace std;
+
+AccumulationBuffer::AccumulationBuffer(int width, int height, unsigned char components) : width(width), height(height),
+	components(components), sums((size_t)width * height * components, 0), counts((size_t)width * height, 0) {
+}
+
+int AccumulationBuffer::getWidth() const {
+	return width;
+}
+
+int AccumulationBuffer::getHeight() const {
+	return height;
+}
+
+unsigned char AccumulationBuffer::getComponents() const {
+	return components;
+}
+
+void AccumulationBuffer::clear() {
+	fill(sums.begin(), sums.end(), 0);
+	fill(counts.begin(), counts.end(), 0);
+}
+
+// Turns the sums into averages
+void AccumulationBuffer::normalize() {
+	normalize(0, height);
+}
+
+void AccumulationBuffer::normalize(int yStart, int yEnd) {
+	const size_t numPixels = (size_t)width * height;
+	for (size_t p = (size_t)yStart * width; p < (size_t)yEnd * width; p++) {
+		if (counts[p] > 1) {
+			for (unsigned char c = 0; c < components; c++) {
+				sums[c * numPixels + p] /= counts[p];
+			}
+			counts[p] = 1;
+		}
+	}
+}
+
+HoleFill::HoleFill() : neighbourStarts(1, 0) {
+}
+
+// Fills every pixel nothing was mapped onto with the average of its
+// neighbours, as worked out by findHoles(). Must be called after
+// normalize().
+void AccumulationBuffer::interpolateErrors() {
+	vector<bool> covered(counts.size());
+	for (size_t p = 0; p < counts.size(); p++) {
+		covered[p] = counts[p] != 0;
+	}
+	fillHoles(findHoles(width, height, covered));
+}
+
+// Every pixel only averages neighbours that are covered or filled in
+// earlier, so the pixels can simply be filled in order. Must be called after
+// normalize().
+void AccumulationBuffer::fillHoles(const HoleFill& holes) {
+	const size_t numPixels = (size_t)width * height;
+	for (size_t i = 0; i < holes.pixels.size(); i++) {
+		const size_t start = holes.neighbourStarts[i];
+		const size_t end = holes.neighbourStarts[i + 1];
+		for (unsigned char c = 0; c < components; c++) {
+			float total = 0;
+			for (size_t j = start; j < end; j++) {
+				total += sums[c * numPixels + holes.neighbours[j]];
+			}
+			sums[c * numPixels + holes.pixels[i]] = total / (unsigned char)(end - start);
+		}
+		counts[holes.pixels[i]] = 1;
+	}
+}
+
+// A pixel that is not covered is filled with the average of its neighbours
+// (wrapping around the edges) once at least PIXELS_FOR_INTERP of them have a
+// value, so holes are filled from the outside in, a ring at a time. Each
+// ring only reads the rings before it, and only the neighbours of the last
+// ring need looking at again, so this costs time in proportion to the holes
+// rather than the image. Pixels that are never reached are left out.
+HoleFill AccumulationBuffer::findHoles(int width, int height, const vector<bool>& covered) {
+	const size_t numPixels = (size_t)width * height;
+	HoleFill result;
+	vector<bool> known(covered);
+	vector<size_t> candidates;
+	for (size_t p = 0; p < numPixels; p++) {
+		if (!known[p]) {
+			candidates.push_back(p);
+		}
+	}
+
+	// The ring each pixel was last queued for, so it is only looked at once
+	// per ring
+	vector<size_t> queued(numPixels, 0);
+	size_t ring = 0;
+	while (!candidates.empty()) {
+		if (outputDebug()) {
+			output << "Looking at " << candidates.size() << " error pixels..." << endl;
+		}
+		const size_t ringStart = result.pixels.size();
+		for (vector<size_t>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+			const int x = *it % width;
+			const int y = *it / width;
+			const size_t start = result.neighbours.size();
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					if (dx == 0 && dy == 0) {
+						continue;
+					}
+					const size_t n = ((y + dy + height) % height) * (size_t)width + (x + dx + width) % width;
+					if (known[n]) {
+						result.neighbours.push_back(n);
+					}
+				}
+			}
+			if (result.neighbours.size() - start < PIXELS_FOR_INTERP) {
+				result.neighbours.resize(start);
+				continue;
+			}
+			result.pixels.push_back(*it);
+			result.neighbourStarts.push_back(result.neighbours.size());
+		}
+		if (result.pixels.size() == ringStart) {
+			// Nothing left to grow from
+			break;
+		}
+
+		ring++;
+		for (size_t i = ringStart; i < result.pixels.size(); i++) {
+			known[result.pixels[i]] = true;
+		}
+		candidates.clear();
+		for (size_t i = ringStart; i < result.pixels.size(); i++) {
+			const int x = result.pixels[i] % width;
+			const int y = result.pixels[i] / width;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					const size_t n = ((y + dy + height) % height) * (size_t)width + (x + dx + width) % width;
+					if (!known[n] && queued[n] != ring) {
+						queued[n] = ring;
+						candidates.push_back(n);
+					}
+				}
+			}
+		}
+	}
+	return result;
+}
+
+// Pixels without a value get ERROR_COLOR, so every pixel of image is written
+// and it does not need clearing beforehand. If plane is given it also gets
+// each component as getPixel() will read it back from image, in separate
+// planes. Must be called after normalize().
+void AccumulationBuffer::writeTo(gdImagePtr image, Channel channel) const {
+	writeTo(image, channel, 0, height);
+}
+
+void AccumulationBuffer::writeTo(gdImagePtr image, Channel channel, int yStart, int yEnd, vector<unsigned char>* plane) const {
+	const size_t numPixels = (size_t)width * height;
+	for (int y = yStart; y < yEnd; y++) {
+		for (int x = 0; x < width; x++) {
+			const size_t p = (size_t)y * width + x;
+			if (counts[p] == 0) {
+				for (unsigned char c = 0; c < components; c++) {
+					const Channel component = getComponent(channel, c);
+					setErrorPixel(image, x, y, component);
+					if (plane != NULL) {
+						(*plane)[c * numPixels + p] = getColor(image, ERROR_COLOR, component);
+					}
+				}
+				continue;
+			}
+			for (unsigned char c = 0; c < components; c++) {
+				const unsigned char value = boundColor(round(sums[c * numPixels + p]));
+				setPixel(image, x, y, value, getComponent(channel, c));
+				if (plane != NULL) {
+					(*plane)[c * numPixels + p] = value;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ACCUMULATIONBUFFER_H
+#define _ACCUMULATIONBUFFER_H
+
+#include <vector>
+#include <cstddef>
+#include "gd.h"
+
+#include "imageutils.h"
+
+// The pixels of an image nothing is mapped onto that can be interpolated,
+// in the order they are filled in, each with the neighbours it averages.
+// Only depends on which pixels are covered, so it can be worked out once
+// and applied every iteration.
+struct HoleFill {
+	std::vector<std::size_t> pixels;
+	// The neighbours of pixels[i] are neighbours[neighbourStarts[i]] up to
+	// neighbours[neighbourStarts[i + 1]]
+	std::vector<std::size_t> neighbourStarts;
+	std::vector<std::size_t> neighbours;
+	HoleFill();
+};
+
+// Collects every value mapped onto each pixel of one channel during a decode
+// iteration. Values are summed in floating point with a hit count per pixel,
+// so overlapping triangles are averaged exactly and only rounded to 8 bits
+// when written out.
+class AccumulationBuffer {
+private:
+	int width;
+	int height;
+	unsigned char components;
+	std::vector<float> sums;
+	std::vector<unsigned int> counts;
+public:
+	AccumulationBuffer(int width, int height, unsigned char components);
+	int getWidth() const;
+	int getHeight() const;
+	unsigned char getComponents() const;
+	void clear();
+	void add(std::size_t pixel, unsigned char component, double value);
+	void hit(std::size_t pixel);
+	float getValue(std::size_t pixel, unsigned char component) const;
+	void normalize();
+	void normalize(int yStart, int yEnd);
+	void interpolateErrors();
+	void fillHoles(const HoleFill& holes);
+	static HoleFill findHoles(int width, int height, const std::vector<bool>& covered);
+	void writeTo(gdImagePtr image, Channel channel) const;
+	void writeTo(gdImagePtr image, Channel channel, int yStart, int yEnd,
+	             std::vector<unsigned char>* plane = NULL) const;
+};
+
+// Components are stored in separate planes
+inline void AccumulationBuffer::add(std::size_t pixel, unsigned char component, double value) {
+	sums[component * (std::size_t)width * height + pixel] += value;
+}
+
+inline void AccumulationBuffer::hit(std::size_t pixel) {
+	counts[pixel]++;
+}
+
+// The average of the values added to a pixel so far, which must be at least
+// one
+inline float AccumulationBuffer::getValue(std::size_t pixel, unsigned char component) const {
+	return sums[component * (std::size_t)width * height + pixel] / counts[pixel];
+}
+
+#endif
@@ -30,6 +30,11 @@
 #define DEFAULT_DEC_FNAME "fractal.png"
 #endif
 
+// Directory --zoom writes its tiles to
+#ifndef DEFAULT_ZOOM_DIR
+#define DEFAULT_ZOOM_DIR "tiles"
+#endif
+
 #ifndef DEFAULT_SIZE
 #define DEFAULT_SIZE 256
 #endif
@@ -78,6 +83,29 @@
 #define DEFAULT_COLOR_MODE FractalImage::T_GREYSCALE
 #endif
 
+// Chroma is fitted as closely as luma unless --chroma-scale loosens it. Any
+// size saved by a looser cutoff comes with about as much lost quality.
+#ifndef DEFAULT_CHROMA_SCALE
+#define DEFAULT_CHROMA_SCALE 1
+#endif
+
+#ifndef DEFAULT_CHECKPOINT_INTERVAL
+#define DEFAULT_CHECKPOINT_INTERVAL 5
+#endif
+
+#ifndef DEFAULT_CHECKPOINT_SUFFIX
+#define DEFAULT_CHECKPOINT_SUFFIX ".ckpt"
+#endif
+
+#ifndef DEFAULT_TILE_OVERLAP
+#define DEFAULT_TILE_OVERLAP 8
+#endif
+
+// 0 for one thread per core
+#ifndef DEFAULT_THREADS
+#define DEFAULT_THREADS 0
+#endif
+
 #ifndef DEFAULT_DIVISION_TYPE
 #define DEFAULT_DIVISION_TYPE DoubleImage::T_LOWENTROPY
 #endif
@@ -90,6 +118,91 @@
 #define DEFAULT_SUBDIVISION_METHOD TriangleTree::M_QUAD
 #endif
 
+// Zero always runs all of the iterations
+#ifndef DEFAULT_TOLERANCE
+#define DEFAULT_TOLERANCE 0
+#endif
+
+// Tolerance --batch decodes to unless --tolerance is given
+#ifndef BATCH_TOLERANCE
+#define BATCH_TOLERANCE 1
+#endif
+
+// Longest side of the thumbnail stored to seed decoding, zero for none
+#ifndef DEFAULT_THUMBNAIL_SIZE
+#define DEFAULT_THUMBNAIL_SIZE 0
+#endif
+
+// One decodes at the full size only
+#ifndef DEFAULT_PYRAMID_LEVELS
+#define DEFAULT_PYRAMID_LEVELS 1
+#endif
+
+// Tolerance every level of --pyramid and every one of --sizes after the
+// smallest decodes to unless --tolerance is given
+#ifndef PYRAMID_TOLERANCE
+#define PYRAMID_TOLERANCE 0.5
+#endif
+
+// Smallest width or height --pyramid decodes at
+#ifndef MIN_PYRAMID_SIZE
+#define MIN_PYRAMID_SIZE 32
+#endif
+
+// Pixels the smallest triangle --lod-depth or --lod-area fits should cover
+// in the decode of the whole tree it is fitted to, which is only as large
+// as that needs
+#ifndef LOD_FIT_POINTS
+#define LOD_FIT_POINTS 64
+#endif
+
+// That decode is at most 1/LOD_FIT_DIVISOR of the output size across, so
+// it always costs much less than an iteration at the output size
+#ifndef LOD_FIT_DIVISOR
+#define LOD_FIT_DIVISOR 3
+#endif
+
+// Domains searched for each triangle --lod-depth or --lod-area fits, the
+// ones nearest to it
+#ifndef LOD_SEARCH_SIZE
+#define LOD_SEARCH_SIZE 32
+#endif
+
+// Iterations of that decode
+#ifndef LOD_FIT_ITERATIONS
+#define LOD_FIT_ITERATIONS 10
+#endif
+
+// Pixels around a --region, and around every area it depends on, whose
+// triangles are decoded as well so that the edges come out the same as in
+// a full decode
+#ifndef REGION_MARGIN
+#define REGION_MARGIN 4
+#endif
+
+// Pixels of the neighbouring tiles rendered around each --zoom tile, so that
+// holes along its edges are filled the same as in a whole image
+#ifndef TILE_BORDER
+#define TILE_BORDER 4
+#endif
+
+// Rows of the output each thread renders at a time when decoding
+#ifndef DECODE_BAND_ROWS
+#define DECODE_BAND_ROWS 16
+#endif
+
+#ifndef DEFAULT_DECODER
+#define DEFAULT_DECODER FractalImage::D_PINGPONG
+#endif
+
+#ifndef DEFAULT_DECODE_ORDER
+#define DEFAULT_DECODE_ORDER DecodePlan::O_DEPENDENCY
+#endif
+
+#ifndef DEFAULT_SUBDIVISION_ORDER
+#define DEFAULT_SUBDIVISION_ORDER TriangleTree::O_BREADTHFIRST
+#endif
+
 #ifndef DEFAULT_EDGE_DETECTION_METHOD
 #define DEFAULT_EDGE_DETECTION_METHOD DoubleImage::M_LAPLACE
 #endif
@@ -128,8 +241,20 @@
 #define MAX_SUBDIVIDE_SIZE 20
 #endif
 
+#ifndef RATE_CONTROL_PASSES
+#define RATE_CONTROL_PASSES 8
+#endif
+
+#ifndef MIN_TARGET_CUTOFF
+#define MIN_TARGET_CUTOFF .5
+#endif
+
+#ifndef MAX_TARGET_CUTOFF
+#define MAX_TARGET_CUTOFF 64
+#endif
+
 #ifndef MAX_NUM_TRIANGLES
-#define MAX_NUM_TRIANGLES 0xFFFF
+#define MAX_NUM_TRIANGLES 0xFFFFFFFE
 #endif
 
 #endif
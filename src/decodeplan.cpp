@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "decodeplan.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <stdexcept>
+
+#include "affinetransform.h"
+#include "mathutils.h"
+#include "output.h"
+#include "constant.h"
+#include "threadutils.h"
+
+using namespace std;
+
+DecodePlan::DecodePlan(const vector<TriangleTree*>& trees, DoubleImage& image, bool inPlace, Order order) : width(image.getWidth()),
+	height(image.getHeight()), sType(image.getSamplingType()), inPlace(inPlace), order(order), channels(trees.size()),
+	sourcePlanes(trees.size()), targetPlanes(trees.size()), lastTarget(NULL) {
+	for (vector<TriangleTree*>::size_type i = 0; i < trees.size(); i++) {
+		ChannelPlan& plan = channels[i];
+		plan.channel = trees[i]->getChannel();
+		plan.components = getNumComponents(plan.channel);
+		vector<size_t> triangleStarts(1, 0);
+		const vector<Triangle*> triangles = trees[i]->getDecodeTriangles();
+		for (vector<Triangle*>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+			addTriangle(plan, image, *it);
+			triangleStarts.push_back(plan.destinations.size());
+		}
+		vector<size_t> triangleOrder;
+		if (inPlace) {
+			triangleOrder = orderTriangles(plan, triangleStarts);
+		}
+		vector<size_t> positions;
+		splitIntoBands(plan, positions);
+		if (inPlace) {
+			plan.sequence.reserve(plan.destinations.size());
+			for (vector<size_t>::const_iterator it = triangleOrder.begin(); it != triangleOrder.end(); it++) {
+				for (size_t j = triangleStarts[*it]; j < triangleStarts[*it + 1]; j++) {
+					plan.sequence.push_back(positions[j]);
+				}
+			}
+			plan.completes.assign(plan.sequence.size(), false);
+			vector<bool> seen((size_t)width * height, false);
+			for (size_t j = plan.sequence.size(); j-- > 0;) {
+				const int d = plan.destinations[plan.sequence[j]];
+				plan.completes[j] = !seen[d];
+				seen[d] = true;
+			}
+		}
+		vector<bool> covered((size_t)width * height, false);
+		for (vector<int>::const_iterator it = plan.destinations.begin(); it != plan.destinations.end(); it++) {
+			covered[*it] = true;
+		}
+		plan.holes = AccumulationBuffer::findHoles(width, height, covered);
+
+		buffers.push_back(AccumulationBuffer(width, height, plan.components));
+		if (!inPlace) {
+			sourcePlanes[i].resize((size_t)width * height * plan.components);
+			targetPlanes[i].resize((size_t)width * height * plan.components);
+		}
+	}
+	if (outputVerbose()) {
+		output << "Compiled decode plan with " << getNumSteps() << " steps." << endl;
+	}
+}
+
+// Must be kept in sync with DoubleImage::mapPoints()
+void DecodePlan::addTriangle(ChannelPlan& plan, DoubleImage& image, const Triangle* t) {
+	const TriFit& fit = t->getTarget();
+	switch(sType) {
+	case DoubleImage::T_BOTHSAMPLE:
+	case DoubleImage::T_SUBSAMPLE: {
+		const vector<Point2D>& points = image.getPointsInside(t);
+		const AffineTransform trans = AffineTransform(*t, *fit.best, fit.pMap);
+		for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
+			addStep(plan, image, fit, trans.transform(*it), *it);
+		}
+		if (sType != DoubleImage::T_BOTHSAMPLE) {
+			break;
+		}
+	}
+	// fall through
+	case DoubleImage::T_SUPERSAMPLE: {
+		const vector<Point2D>& points = image.getPointsInside(fit.best);
+		const AffineTransform trans = AffineTransform(*fit.best, *t, fit.pMap);
+		for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
+			addStep(plan, image, fit, *it, trans.transform(*it));
+		}
+		break;
+	}
+	}
+}
+
+void DecodePlan::addStep(ChannelPlan& plan, const DoubleImage& image, const TriFit& fit, const Point2D& source, const Point2D& dest) {
+	plan.destinations.push_back(image.doubleToIntY(dest.getY()) * width + image.doubleToIntX(dest.getX()));
+	plan.sources.push_back(image.doubleToIntY(source.getY()) * width + image.doubleToIntX(source.getX()));
+	for (unsigned char c = 0; c < plan.components; c++) {
+		plan.saturations.push_back(fit.saturation[c]);
+		plan.brightnesses.push_back(fit.brightness[c]);
+	}
+}
+
+int DecodePlan::getNumBands() const {
+	return (height + DECODE_BAND_ROWS - 1) / DECODE_BAND_ROWS;
+}
+
+// Every band writes to its own rows only, so bands can run on separate
+// threads. The sort is stable, so each pixel still sees its steps in the
+// same order and the result does not depend on the number of threads.
+// positions is filled with the new index of every step.
+void DecodePlan::splitIntoBands(ChannelPlan& plan, vector<size_t>& positions) const {
+	const int numBands = getNumBands();
+	const size_t numSteps = plan.destinations.size();
+	const unsigned char components = plan.components;
+
+	plan.bandStarts.assign(numBands + 1, 0);
+	for (size_t i = 0; i < numSteps; i++) {
+		plan.bandStarts[plan.destinations[i] / width / DECODE_BAND_ROWS + 1]++;
+	}
+	for (int b = 0; b < numBands; b++) {
+		plan.bandStarts[b + 1] += plan.bandStarts[b];
+	}
+
+	vector<size_t> next(plan.bandStarts.begin(), plan.bandStarts.end() - 1);
+	positions.resize(numSteps);
+	vector<int> destinations(numSteps);
+	vector<int> sources(numSteps);
+	vector<double> saturations(numSteps * components);
+	vector<double> brightnesses(numSteps * components);
+	for (size_t i = 0; i < numSteps; i++) {
+		const size_t j = next[plan.destinations[i] / width / DECODE_BAND_ROWS]++;
+		positions[i] = j;
+		destinations[j] = plan.destinations[i];
+		sources[j] = plan.sources[i];
+		for (unsigned char c = 0; c < components; c++) {
+			saturations[j * components + c] = plan.saturations[i * components + c];
+			brightnesses[j * components + c] = plan.brightnesses[i * components + c];
+		}
+	}
+	plan.destinations.swap(destinations);
+	plan.sources.swap(sources);
+	plan.saturations.swap(saturations);
+	plan.brightnesses.swap(brightnesses);
+}
+
+// With O_DEPENDENCY a triangle comes after the triangles that write the
+// pixels its domain reads, so when decoding in place it already sees their
+// values from the same pass. Where the triangles depend on each other in a
+// cycle the one with the fewest dependencies left goes first. Ties keep the
+// order of the tree.
+vector<size_t> DecodePlan::orderTriangles(const ChannelPlan& plan, const vector<size_t>& triangleStarts) const {
+	const size_t numTriangles = triangleStarts.size() - 1;
+	vector<size_t> result;
+	result.reserve(numTriangles);
+	if (order == O_TREE) {
+		for (size_t k = 0; k < numTriangles; k++) {
+			result.push_back(k);
+		}
+		return result;
+	}
+
+	// Pixels written by several triangles belong to the last of them
+	vector<size_t> owners((size_t)width * height, numTriangles);
+	for (size_t k = 0; k < numTriangles; k++) {
+		for (size_t i = triangleStarts[k]; i < triangleStarts[k + 1]; i++) {
+			owners[plan.destinations[i]] = k;
+		}
+	}
+
+	vector<vector<size_t> > dependents(numTriangles);
+	vector<size_t> remaining(numTriangles, 0);
+	for (size_t k = 0; k < numTriangles; k++) {
+		vector<size_t> inputs;
+		for (size_t i = triangleStarts[k]; i < triangleStarts[k + 1]; i++) {
+			const size_t owner = owners[plan.sources[i]];
+			if (owner != numTriangles && owner != k) {
+				inputs.push_back(owner);
+			}
+		}
+		sort(inputs.begin(), inputs.end());
+		inputs.erase(unique(inputs.begin(), inputs.end()), inputs.end());
+		for (vector<size_t>::const_iterator it = inputs.begin(); it != inputs.end(); it++) {
+			dependents[*it].push_back(k);
+		}
+		remaining[k] = inputs.size();
+	}
+
+	set<pair<size_t, size_t> > ready;
+	for (size_t k = 0; k < numTriangles; k++) {
+		ready.insert(make_pair(remaining[k], k));
+	}
+	vector<bool> done(numTriangles, false);
+	while (!ready.empty()) {
+		const size_t k = ready.begin()->second;
+		ready.erase(ready.begin());
+		done[k] = true;
+		result.push_back(k);
+		for (vector<size_t>::const_iterator it = dependents[k].begin(); it != dependents[k].end(); it++) {
+			if (done[*it]) {
+				continue;
+			}
+			ready.erase(make_pair(remaining[*it], *it));
+			remaining[*it]--;
+			ready.insert(make_pair(remaining[*it], *it));
+		}
+	}
+	return result;
+}
+
+bool DecodePlan::matches(const DoubleImage& image, bool inPlace, Order order) const {
+	return image.getWidth() == width && image.getHeight() == height && image.getSamplingType() == sType &&
+	       this->inPlace == inPlace && (!inPlace || this->order == order);
+}
+
+size_t DecodePlan::getNumSteps() const {
+	size_t total = 0;
+	for (vector<ChannelPlan>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		total += it->destinations.size();
+	}
+	return total;
+}
+
+// Renders every channel of from into to, the same as TriangleTree::renderTo().
+// from is only read if it is not the image the last call wrote to.
+void DecodePlan::execute(const gdImagePtr from, gdImagePtr to, bool fixErrors, unsigned int threads) {
+	if (gdImageSX(from) != width || gdImageSY(from) != height ||
+	    gdImageSX(to) != width || gdImageSY(to) != height) {
+		throw logic_error("dimensions don't match!!!");
+	}
+	if (inPlace) {
+		throw logic_error("decode plan is in place");
+	}
+	const bool readFrom = (from != lastTarget);
+	for (vector<ChannelPlan>::size_type i = 0; i < channels.size(); i++) {
+		const ChannelPlan& plan = channels[i];
+		if (outputVerbose()) {
+			output << "Rendering channel " << channelToString(plan.channel) << "..." << endl;
+		}
+		AccumulationBuffer& buffer = buffers[i];
+		buffer.clear();
+		if (readFrom) {
+			readSource(plan, from, sourcePlanes[i], threads);
+		}
+		run(plan, sourcePlanes[i], buffer, threads);
+		if (fixErrors) {
+			buffer.fillHoles(plan.holes);
+		}
+		parallelFor(getNumBands(), threads, [&](size_t band) {
+			buffer.writeTo(to, plan.channel, band * DECODE_BAND_ROWS, min(height, (int)(band + 1) * DECODE_BAND_ROWS),
+			               &targetPlanes[i]);
+		});
+		sourcePlanes[i].swap(targetPlanes[i]);
+	}
+	lastTarget = to;
+}
+
+// Must be called whenever the image the last execute() wrote to is changed
+// by anything else, as its values are otherwise taken from the source
+// planes
+void DecodePlan::forgetSource() {
+	lastTarget = NULL;
+}
+
+// Sources may lie in any band, so all of them are read before any band is
+// rendered
+void DecodePlan::readSource(const ChannelPlan& plan, const gdImagePtr from, vector<unsigned char>& source, unsigned int threads) const {
+	const size_t numPixels = (size_t)width * height;
+	const unsigned char components = plan.components;
+	parallelFor(getNumBands(), threads, [&](size_t band) {
+		const int yEnd = min(height, (int)(band + 1) * DECODE_BAND_ROWS);
+		for (unsigned char c = 0; c < components; c++) {
+			const Channel component = getComponent(plan.channel, c);
+			for (int y = band * DECODE_BAND_ROWS; y < yEnd; y++) {
+				for (int x = 0; x < width; x++) {
+					source[c * numPixels + y * width + x] = getPixel(from, x, y, component, false);
+				}
+			}
+		}
+	});
+}
+
+// Adds up the values mapped onto each pixel in the same order as
+// DoubleImage::mapPoint() would, and leaves the averages in to.
+void DecodePlan::run(const ChannelPlan& plan, const vector<unsigned char>& source, AccumulationBuffer& to, unsigned int threads) const {
+	const size_t numPixels = (size_t)width * height;
+	const unsigned char components = plan.components;
+	parallelFor(getNumBands(), threads, [&](size_t band) {
+		for (size_t i = plan.bandStarts[band]; i < plan.bandStarts[band + 1]; i++) {
+			const int d = plan.destinations[i];
+			const int s = plan.sources[i];
+			for (unsigned char c = 0; c < components; c++) {
+				to.add(d, c, source[c * numPixels + s] * plan.saturations[i * components + c] +
+				             plan.brightnesses[i * components + c]);
+			}
+			to.hit(d);
+		}
+		to.normalize(band * DECODE_BAND_ROWS, min(height, (int)(band + 1) * DECODE_BAND_ROWS));
+	});
+}
+
+// Decodes one iteration Gauss-Seidel style: the steps run one at a time in
+// the planned order and read the pixels as they are so far in this pass, so
+// later triangles already see the values written by earlier ones. A pixel
+// several steps map onto only takes its new value once the last of them has
+// run, so it is always a whole average and the image settles on the same
+// fixed point as the other decoders. Needs a
+// plan made with inPlace, and runs on one thread.
+void DecodePlan::executeInPlace(gdImagePtr image, bool fixErrors) {
+	if (!inPlace) {
+		throw logic_error("decode plan is not in place");
+	}
+	lastTarget = NULL;
+	if (gdImageSX(image) != width || gdImageSY(image) != height) {
+		throw logic_error("dimensions don't match!!!");
+	}
+	for (vector<ChannelPlan>::size_type i = 0; i < channels.size(); i++) {
+		const ChannelPlan& plan = channels[i];
+		if (outputVerbose()) {
+			output << "Rendering channel " << channelToString(plan.channel) << " in place..." << endl;
+		}
+		AccumulationBuffer& buffer = buffers[i];
+		buffer.clear();
+		runInPlace(plan, image, buffer);
+		buffer.normalize();
+		if (fixErrors) {
+			buffer.fillHoles(plan.holes);
+		}
+		buffer.writeTo(image, plan.channel);
+	}
+}
+
+void DecodePlan::runInPlace(const ChannelPlan& plan, const gdImagePtr image, AccumulationBuffer& to) const {
+	const size_t numPixels = (size_t)width * height;
+	const unsigned char components = plan.components;
+
+	// The pass works on its own unrounded copy of the channel
+	vector<float> current(numPixels * components);
+	for (unsigned char c = 0; c < components; c++) {
+		const Channel component = getComponent(plan.channel, c);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				current[c * numPixels + y * width + x] = getPixel(image, x, y, component, false);
+			}
+		}
+	}
+
+	for (size_t j = 0; j < plan.sequence.size(); j++) {
+		const size_t i = plan.sequence[j];
+		const int d = plan.destinations[i];
+		const int s = plan.sources[i];
+		for (unsigned char c = 0; c < components; c++) {
+			to.add(d, c, current[c * numPixels + s] * plan.saturations[i * components + c] +
+			             plan.brightnesses[i * components + c]);
+		}
+		to.hit(d);
+		if (!plan.completes[j]) {
+			continue;
+		}
+		for (unsigned char c = 0; c < components; c++) {
+			current[c * numPixels + d] = to.getValue(d, c);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _DECODEPLAN_H
+#define _DECODEPLAN_H
+
+#include <vector>
+#include <cstddef>
+#include "gd.h"
+
+#include "doubleimage.h"
+#include "triangletree.h"
+#include "imageutils.h"
+#include "accumulationbuffer.h"
+
+// The pixel mapping of every terminal triangle, worked out once for a given
+// output size. Every decode iteration is then just a pass over flat arrays
+// instead of walking the trees and transforming each point again.
+class DecodePlan {
+public:
+	// The order triangles are visited in when decoding in place
+	enum Order {
+		O_TREE,
+		O_DEPENDENCY
+	};
+private:
+	// One step per mapped pixel, with components s/o pairs per step. Steps
+	// are grouped into bands of destination rows, and within a band are in
+	// the order DoubleImage::mapPoints() visits them.
+	struct ChannelPlan {
+		Channel channel;
+		unsigned char components;
+		std::vector<int> destinations;
+		std::vector<int> sources;
+		std::vector<double> saturations;
+		std::vector<double> brightnesses;
+		std::vector<std::size_t> bandStarts;
+		// Indices of the steps in the order executeInPlace() runs them,
+		// only filled in for in place plans, and whether each is the last
+		// of the steps in the sequence to map onto its pixel
+		std::vector<std::size_t> sequence;
+		std::vector<bool> completes;
+		// The pixels no step maps onto and how to fill them in
+		HoleFill holes;
+	};
+	int width;
+	int height;
+	DoubleImage::SamplingType sType;
+	bool inPlace;
+	Order order;
+	std::vector<ChannelPlan> channels;
+	// Working space for every channel, kept from one iteration to the next
+	// so that nothing is allocated once the plan exists. The source planes
+	// hold the values an iteration reads, and the target planes get the
+	// values it writes. They swap roles afterwards, so as long as the next
+	// iteration reads the image this one wrote it does not read it back.
+	std::vector<AccumulationBuffer> buffers;
+	std::vector<std::vector<unsigned char> > sourcePlanes;
+	std::vector<std::vector<unsigned char> > targetPlanes;
+	gdImagePtr lastTarget;
+
+	void addStep(ChannelPlan& plan, const DoubleImage& image, const TriFit& fit, const Point2D& source, const Point2D& dest);
+	void addTriangle(ChannelPlan& plan, DoubleImage& image, const Triangle* t);
+	void splitIntoBands(ChannelPlan& plan, std::vector<std::size_t>& positions) const;
+	std::vector<std::size_t> orderTriangles(const ChannelPlan& plan, const std::vector<std::size_t>& triangleStarts) const;
+	int getNumBands() const;
+	void readSource(const ChannelPlan& plan, const gdImagePtr from, std::vector<unsigned char>& source, unsigned int threads) const;
+	void run(const ChannelPlan& plan, const std::vector<unsigned char>& source, AccumulationBuffer& to, unsigned int threads) const;
+	void runInPlace(const ChannelPlan& plan, const gdImagePtr image, AccumulationBuffer& to) const;
+public:
+	DecodePlan(const std::vector<TriangleTree*>& trees, DoubleImage& image, bool inPlace = false, Order order = O_TREE);
+	bool matches(const DoubleImage& image, bool inPlace = false, Order order = O_TREE) const;
+	std::size_t getNumSteps() const;
+	void execute(const gdImagePtr from, gdImagePtr to, bool fixErrors, unsigned int threads = 1);
+	void executeInPlace(gdImagePtr image, bool fixErrors);
+	void forgetSource();
+};
+
+#endif
@@ -33,14 +33,15 @@
 
 using namespace std;
 
-DoubleImage::DoubleImage() : image(NULL), sType(DEFAULT_SAMPLING_TYPE), dType(DEFAULT_DIVISION_TYPE), metric(DEFAULT_METRIC), edMethod(DEFAULT_EDGE_DETECTION_METHOD) {
+DoubleImage::DoubleImage() : image(NULL), windowX(0), windowY(0), fullWidth(0), fullHeight(0), sType(DEFAULT_SAMPLING_TYPE), dType(DEFAULT_DIVISION_TYPE), metric(DEFAULT_METRIC), edMethod(DEFAULT_EDGE_DETECTION_METHOD) {
 }
 
-DoubleImage::DoubleImage(gdImagePtr image) : sType(DEFAULT_SAMPLING_TYPE), dType(DEFAULT_DIVISION_TYPE), metric(DEFAULT_METRIC), edMethod(DEFAULT_EDGE_DETECTION_METHOD) {
+DoubleImage::DoubleImage(gdImagePtr image) : windowX(0), windowY(0), fullWidth(0), fullHeight(0), sType(DEFAULT_SAMPLING_TYPE), dType(DEFAULT_DIVISION_TYPE), metric(DEFAULT_METRIC), edMethod(DEFAULT_EDGE_DETECTION_METHOD) {
 	copyImage(&this->image, image);
 }
 
-DoubleImage::DoubleImage(const DoubleImage& img) : sType(img.sType), dType(img.dType), metric(img.metric), edMethod(img.edMethod) {
+DoubleImage::DoubleImage(const DoubleImage& img) : windowX(img.windowX), windowY(img.windowY), fullWidth(img.fullWidth),
+	fullHeight(img.fullHeight), sType(img.sType), dType(img.dType), metric(img.metric), edMethod(img.edMethod) {
 	copyImage(&(this->image), img.image);
 	for(map<Channel, gdImagePtr>::const_iterator it = img.edges.begin(); it != img.edges.end(); it++) {
 		copyImage(&edges[it->first], it->second);
@@ -48,19 +49,34 @@ DoubleImage::DoubleImage(const DoubleImage& img) : sType(img.sType), dType(img.d
 }
 
 DoubleImage::DoubleImage(gdImagePtr image, SamplingType sType, DivisionType dType, Metric metric, EdgeDetectionMethod edMethod) :
-	sType(sType), dType(dType), metric(metric), edMethod(edMethod) {
+	windowX(0), windowY(0), fullWidth(0), fullHeight(0), sType(sType), dType(dType), metric(metric), edMethod(edMethod) {
 	copyImage(&this->image, image);
 }
 
 DoubleImage& DoubleImage::operator=(const DoubleImage& img) {
 	if (this != &img) {
+		if (this->image != NULL) {
+			gdFree(this->image);
+		}
 		copyImage(&(this->image), img.image);
 		for(map<Channel, gdImagePtr>::const_iterator it = img.edges.begin(); it != img.edges.end(); it++) {
+			map<Channel, gdImagePtr>::iterator old = edges.find(it->first);
+			if (old != edges.end() && old->second != NULL) {
+				gdFree(old->second);
+			}
 			copyImage(&edges[it->first], it->second);
 		}
 		this->sType = img.sType;
 		this->dType = img.dType;
 		this->metric = img.metric;
+		this->windowX = img.windowX;
+		this->windowY = img.windowY;
+		this->fullWidth = img.fullWidth;
+		this->fullHeight = img.fullHeight;
+		// The points inside a triangle depend on the size of the image
+		pointsCache.clear();
+		clearDomainStats();
+		clearDivideCache();
 	}
 	return *this;
 }
@@ -84,6 +100,38 @@ int DoubleImage::getHeight() const {
 	return gdImageSY(image);
 }
 
+// The size of the image the grid is laid out on, which is larger than the
+// image itself if it has a window
+int DoubleImage::getFullWidth() const {
+	return (fullWidth != 0)?fullWidth:gdImageSX(image);
+}
+
+int DoubleImage::getFullHeight() const {
+	return (fullHeight != 0)?fullHeight:gdImageSY(image);
+}
+
+int DoubleImage::getWindowX() const {
+	return windowX;
+}
+
+int DoubleImage::getWindowY() const {
+	return windowY;
+}
+
+// Makes the image stand for the part of a fullWidth by fullHeight image
+// starting at x, y. Coordinates keep referring to the full image, so
+// triangles map onto the same pixels as they would there, and points outside
+// the window are clamped to its edge. Only meant for decoding.
+void DoubleImage::setWindow(int x, int y, int fullWidth, int fullHeight) {
+	windowX = x;
+	windowY = y;
+	this->fullWidth = fullWidth;
+	this->fullHeight = fullHeight;
+	pointsCache.clear();
+	clearDomainStats();
+	clearDivideCache();
+}
+
 DoubleImage::Metric DoubleImage::getMetric() const {
 	return metric;
 }
@@ -130,8 +178,24 @@ void DoubleImage::copyImage(gdImagePtr* to, gdImagePtr from) {
 }
 
 void DoubleImage::setImage(gdImagePtr image) {
+	if (this->image == NULL || gdImageSX(this->image) != gdImageSX(image) || gdImageSY(this->image) != gdImageSY(image)) {
+		pointsCache.clear();
+	}
 	gdFree(this->image);
 	copyImage(&this->image, image);
+	clearDomainStats();
+	clearDivideCache();
+}
+
+// Exchanges the image with one of the same size without copying either,
+// leaving the old image in image
+void DoubleImage::swapImage(gdImagePtr& image) {
+	if (gdImageSX(this->image) != gdImageSX(image) || gdImageSY(this->image) != gdImageSY(image)) {
+		throw logic_error("dimensions don't match!!!");
+	}
+	swap(this->image, image);
+	clearDomainStats();
+	clearDivideCache();
 }
 
 gdImagePtr DoubleImage::getImage() const {
@@ -157,43 +221,50 @@ void DoubleImage::generateEdges() {
 		edges[C_BLUE] = edgeDetectSobel(image, C_BLUE);
 		break;
 	}
+	clearDivideCache();
 }
 
 double DoubleImage::snapXToGrid(double x) const {
-	return round( x * (gdImageSX(image)-1) ) / (gdImageSX(image) - 1);
+	return round( x * (getFullWidth()-1) ) / (getFullWidth() - 1);
 }
 
 double DoubleImage::snapYToGrid(double y) const {
-	return round(y * (gdImageSY(image)-1) ) / (gdImageSY(image) - 1);
+	return round(y * (getFullHeight()-1) ) / (getFullHeight() - 1);
 }
 
 double DoubleImage::floorXToGrid(double x) const {
-	return floor(x * (gdImageSX(image)-1) ) / (gdImageSX(image) - 1);
+	return floor(x * (getFullWidth()-1) ) / (getFullWidth() - 1);
 }
 
 double DoubleImage::floorYToGrid(double y) const {
-	return floor(y * (gdImageSY(image)-1) ) / (gdImageSY(image) - 1);
+	return floor(y * (getFullHeight()-1) ) / (getFullHeight() - 1);
 }
 
 double DoubleImage::ceilXToGrid(double x) const {
-	return ceil (x * (gdImageSX(image)-1) ) / (gdImageSX(image) - 1);
+	return ceil (x * (getFullWidth()-1) ) / (getFullWidth() - 1);
 }
 
 double DoubleImage::ceilYToGrid(double y) const {
-	return ceil (y * (gdImageSY(image)-1) ) / (gdImageSY(image) - 1);
+	return ceil (y * (getFullHeight()-1) ) / (getFullHeight() - 1);
 }
 
 int DoubleImage::doubleToIntX(double x) const {
-	return doubleToInt(x, 0, gdImageSX(image)-1);
+	if (fullWidth == 0) {
+		return doubleToInt(x, 0, gdImageSX(image)-1);
+	}
+	return min(max(doubleToInt(x, 0, fullWidth-1) - windowX, 0), gdImageSX(image)-1);
 }
 
 int DoubleImage::doubleToIntY(double y) const {
-	return doubleToInt(y, 0, gdImageSY(image)-1);
+	if (fullHeight == 0) {
+		return doubleToInt(y, 0, gdImageSY(image)-1);
+	}
+	return min(max(doubleToInt(y, 0, fullHeight-1) - windowY, 0), gdImageSY(image)-1);
 }
 
 double DoubleImage::valueAt(double x, double y, Channel channel) const {
-	const int _x = doubleToInt(x, 0, gdImageSX(image)-1);
-	const int _y = doubleToInt(y, 0, gdImageSY(image)-1);
+	const int _x = doubleToIntX(x);
+	const int _y = doubleToIntY(y);
 
 	const int val = getPixel(image, _x, _y, channel, false);
 	return val;
@@ -203,7 +274,9 @@ double DoubleImage::edgeAt(double x, double y, Channel channel) const {
 	const int _x = doubleToIntX(x);
 	const int _y = doubleToIntY(y);
 
-	const int val = getPixel(edges.find(channel)->second, _x, _y, C_GREY, false);
+	// Colour shared between components splits on the edges of the grey image
+	const Channel edgeChannel = (getNumComponents(channel) > 1)?C_GREY:getStorageChannel(channel);
+	const int val = getPixel(edges.find(edgeChannel)->second, _x, _y, C_GREY, false);
 	return val;
 }
 
@@ -230,6 +303,14 @@ TriFit DoubleImage::getOptimalFit(const Triangle* smaller, const Triangle* large
 	TriFit best(0, 0, -1, TriFit::P000, larger);
 
 	const TriFit::PointMap tm = TriFit::P000;
+	const unsigned char components = getNumComponents(channel);
+
+	// When supersampling the domain side is the same for every point map
+	const bool cached = (sType == T_SUPERSAMPLE);
+	DomainStats stats;
+	if (cached) {
+		stats = getDomainStats(larger, channel, allConfigs[tm]);
+	}
 
 	for (map<TriFit::PointMap, vector<double> >::const_iterator it = allConfigs.begin(); it != allConfigs.end(); it++) {
 		if (it->first == TriFit::P000) {
@@ -239,85 +320,200 @@ TriFit DoubleImage::getOptimalFit(const Triangle* smaller, const Triangle* large
 		const vector<double>& largerPoints = (sType == T_SUBSAMPLE)?it->second:allConfigs[tm];
 		const vector<double>& smallerPoints = (sType == T_SUBSAMPLE)?allConfigs[tm]:it->second;
 
-		double domainSum = sum(largerPoints.begin(), largerPoints.end());
-		double domainSquaresSum = sumSquares(largerPoints.begin(), largerPoints.end());
-		double productSum = dotProduct(largerPoints.begin(), largerPoints.end(),
-		                               smallerPoints.begin(), smallerPoints.end());
+		// Every component gets its own intensity map, but they all share
+		// the domain and the point map so the error is taken over all of them
+		const size_t n = smallerPoints.size() / components;
+		double s[TriFit::MAX_COMPONENTS];
+		double o[TriFit::MAX_COMPONENTS];
+		double r = 0;
+
+		for (unsigned char c = 0; c < components; c++) {
+			const vector<double>::const_iterator largerStart = largerPoints.begin() + c * n;
+			const vector<double>::const_iterator smallerStart = smallerPoints.begin() + c * n;
+			const double componentError = cached?
+			                              fitComponent(largerStart, smallerStart, n, stats.sum[c], stats.squaresSum[c], s[c], o[c]):
+			                              fitComponent(largerStart, smallerStart, n, s[c], o[c]);
+			if (metric == M_SUP) {
+				r = max(r, componentError);
+			} else {
+				r += componentError / components;
+			}
+		}
+
+		if (r < best.error || best.error == -1) {
+			for (unsigned char c = 0; c < components; c++) {
+				best.saturation[c] = s[c];
+				best.brightness[c] = o[c];
+			}
+			best.error = r;
+			best.pMap = it->first;
+		}
 
-		double rangeSum = sum(smallerPoints.begin(), smallerPoints.end());
-		double rangeSquaresSum = sumSquares(smallerPoints.begin(), smallerPoints.end());
-		double n = smallerPoints.size();
+	}
+	return best;
+}
 
-		// Y. Fisher lists n^2 here but it should be just n
-		double denom = ((n * domainSquaresSum) - (domainSum * domainSum));
+// Finds the intensity map s*larger+o that best approximates smaller and
+// returns its error under the current metric.
+double DoubleImage::fitComponent(vector<double>::const_iterator largerPoints, vector<double>::const_iterator smallerPoints,
+                                 size_t count, double& s, double& o) const {
+	const vector<double>::const_iterator largerEnd = largerPoints + count;
+	return fitComponent(largerPoints, smallerPoints, count, sum(largerPoints, largerEnd),
+	                    sumSquares(largerPoints, largerEnd), s, o);
+}
 
-		double s;
-		double o;
+double DoubleImage::fitComponent(vector<double>::const_iterator largerPoints, vector<double>::const_iterator smallerPoints,
+                                 size_t count, double domainSum, double domainSquaresSum, double& s, double& o) const {
+	const vector<double>::const_iterator largerEnd = largerPoints + count;
+	const vector<double>::const_iterator smallerEnd = smallerPoints + count;
 
-		if (doublesEqual(denom, 0.0)) {
-			s = 0;
-			o = rangeSum / (n);
-		} else {
-			// Again, n^2 is written but it should be n
-			s = ((n * productSum) - (domainSum * rangeSum)) / denom;
+	double productSum = dotProduct(largerPoints, largerEnd,
+	                               smallerPoints, smallerEnd);
 
-			if (s > 1) {
-				s = 1;
-			} else if (s < 0) {
-				s = 0;
-			}
-			// n^2 is written but it should be just n
-			o = (rangeSum - (s*domainSum)) / n;
+	double rangeSum = sum(smallerPoints, smallerEnd);
+	double rangeSquaresSum = sumSquares(smallerPoints, smallerEnd);
+	double n = count;
 
-			if (o < -gdRedMax) {
-				o = -gdRedMax;
-			} else if (o > gdRedMax) {
-				o = gdRedMax;
-			}
+	// Y. Fisher lists n^2 here but it should be just n
+	double denom = ((n * domainSquaresSum) - (domainSum * domainSum));
+
+	if (doublesEqual(denom, 0.0)) {
+		s = 0;
+		o = rangeSum / (n);
+	} else {
+		// Again, n^2 is written but it should be n
+		s = ((n * productSum) - (domainSum * rangeSum)) / denom;
+
+		if (s > 1) {
+			s = 1;
+		} else if (s < 0) {
+			s = 0;
 		}
+		// n^2 is written but it should be just n
+		o = (rangeSum - (s*domainSum)) / n;
 
-		double r = 0;
-		switch(metric) {
-		default:
-		case M_RMS:
-			// Y. Fisher lists one term as o*n^2 which should actually be o*n
-			r = (s*(s*domainSquaresSum + 2*o*domainSum - 2*productSum) + o*(o*n - 2*rangeSum) + rangeSquaresSum)/n;
+		if (o < -gdRedMax) {
+			o = -gdRedMax;
+		} else if (o > gdRedMax) {
+			o = gdRedMax;
+		}
+	}
+
+	double r = 0;
+	switch(metric) {
+	default:
+	case M_RMS:
+		// Y. Fisher lists one term as o*n^2 which should actually be o*n
+		r = (s*(s*domainSquaresSum + 2*o*domainSum - 2*productSum) + o*(o*n - 2*rangeSum) + rangeSquaresSum)/n;
 /*
-			for (size_t j = 0; j < allConfigs[tm].size(); j ++) {
-				double t = (s * largerPoints[j] + o - smallerPoints[j]);
-				r += t * t;
-			}
+		for (size_t j = 0; j < count; j ++) {
+			double t = (s * largerPoints[j] + o - smallerPoints[j]);
+			r += t * t;
+		}
 
-			r /= n;
+		r /= n;
 */
-			break;
-		case M_SUP:
-			for(size_t j = 0; j < allConfigs[tm].size(); j++) {
-				double t = (s*largerPoints[j]+o - smallerPoints[j]);
-				if (t > r) {
-					r = t;
-				}
+		break;
+	case M_SUP:
+		for(size_t j = 0; j < count; j++) {
+			double t = (s*largerPoints[j]+o - smallerPoints[j]);
+			if (t > r) {
+				r = t;
 			}
-			r *= r;
-			break;
 		}
-		if (r < best.error || best.error == -1) {
-			best.saturation = s;
-			best.brightness = o;
-			best.error = r;
-			best.pMap = it->first;
+		r *= r;
+		break;
+	}
+	return r;
+}
+
+// domainPoints must be the domain sampled at its own pixels, one run of
+// values per component. Filled lazily, and safe to call from several threads.
+DoubleImage::DomainStats DoubleImage::getDomainStats(const Triangle* domain, Channel channel, const vector<double>& domainPoints) {
+	const DomainKey key(domain, channel);
+	{
+		lock_guard<mutex> guard(domainStatsLock);
+		map<DomainKey, DomainStats>::const_iterator it = domainStatsCache.find(key);
+		if (it != domainStatsCache.end()) {
+			return it->second;
 		}
+	}
 
+	const unsigned char components = getNumComponents(channel);
+	const size_t n = domainPoints.size() / components;
+	DomainStats stats;
+	for (unsigned char c = 0; c < components; c++) {
+		const vector<double>::const_iterator start = domainPoints.begin() + c * n;
+		stats.sum[c] = sum(start, start + n);
+		stats.squaresSum[c] = sumSquares(start, start + n);
 	}
-	return best;
+
+	lock_guard<mutex> guard(domainStatsLock);
+	domainStatsCache[key] = stats;
+	return stats;
+}
+
+void DoubleImage::clearDomainStats() {
+	lock_guard<mutex> guard(domainStatsLock);
+	domainStatsCache.clear();
+}
+
+// Error of the intensity map s*larger+o under the current metric, for fits
+// that already have their s and o
+double DoubleImage::componentError(vector<double>::const_iterator largerPoints, vector<double>::const_iterator smallerPoints,
+                                   size_t count, double s, double o) const {
+	double r = 0;
+	for (size_t j = 0; j < count; j++) {
+		const double t = (s * largerPoints[j] + o - smallerPoints[j]);
+		if (metric == M_SUP) {
+			r = max(r, t * t);
+		} else {
+			r += t * t;
+		}
+	}
+	return (metric == M_SUP)?r:(r / count);
+}
+
+// Error of an existing fit against the current image, measured the same way
+// getOptimalFit() measures the fits it finds
+double DoubleImage::getFitError(const Triangle* smaller, const TriFit& fit, Channel channel) {
+	if (sType == T_BOTHSAMPLE) {
+		this->sType = T_SUBSAMPLE;
+		const double sub = getFitError(smaller, fit, channel);
+		this->sType = T_SUPERSAMPLE;
+		const double super = getFitError(smaller, fit, channel);
+		this->sType = T_BOTHSAMPLE;
+		return min(sub, super);
+	}
+
+	map<TriFit::PointMap, vector<double> > allConfigs = (sType == T_SUBSAMPLE)?getAllConfigurations(smaller, fit.best, channel):getAllConfigurations(fit.best, smaller, channel);
+	const vector<double>& largerPoints = (sType == T_SUBSAMPLE)?allConfigs[fit.pMap]:allConfigs[TriFit::P000];
+	const vector<double>& smallerPoints = (sType == T_SUBSAMPLE)?allConfigs[TriFit::P000]:allConfigs[fit.pMap];
+
+	const unsigned char components = getNumComponents(channel);
+	const size_t n = smallerPoints.size() / components;
+	if (n == 0 || largerPoints.size() != smallerPoints.size()) {
+		return -1;
+	}
+	double r = 0;
+	for (unsigned char c = 0; c < components; c++) {
+		const double componentErr = componentError(largerPoints.begin() + c * n, smallerPoints.begin() + c * n,
+		                                           n, fit.saturation[c], fit.brightness[c]);
+		if (metric == M_SUP) {
+			r = max(r, componentErr);
+		} else {
+			r += componentErr / components;
+		}
+	}
+	return r;
 }
 
 double DoubleImage::getYInc() const {
-	return 1.0 / ((double)gdImageSY(image)-1);
+	return 1.0 / ((double)getFullHeight()-1);
 }
 
 double DoubleImage::getXInc() const {
-	return 1.0 / ((double)gdImageSX(image)-1);
+	return 1.0 / ((double)getFullWidth()-1);
 }
 
 const vector<Point2D>& DoubleImage::getPointsInside(const Triangle* t) {
@@ -414,8 +610,8 @@ TriFit DoubleImage::getBestMatch(const Triangle* smaller, list<Triangle*>::const
 	return result;
 }
 
-void DoubleImage::mapPoints(const Triangle* t, TriFit fit, gdImagePtr to, Channel channel) {
-	if (gdImageSX(image) != gdImageSX(to) || gdImageSY(image) != gdImageSY(to)) {
+void DoubleImage::mapPoints(const Triangle* t, TriFit fit, AccumulationBuffer& to, Channel channel) {
+	if (gdImageSX(image) != to.getWidth() || gdImageSY(image) != to.getHeight()) {
 		throw logic_error("dimensions don't match!!!");
 	}
 
@@ -448,30 +644,23 @@ void DoubleImage::mapPoints(const Triangle* t, TriFit fit, gdImagePtr to, Channe
 	}
 }
 
-void DoubleImage::mapPoint(gdImagePtr to, const TriFit& fit, const Point2D& source, const Point2D& dest, Channel channel) {
-	const int d_x = doubleToIntX(dest.getX());
-	const int d_y = doubleToIntY(dest.getY());
+void DoubleImage::mapPoint(AccumulationBuffer& to, const TriFit& fit, const Point2D& source, const Point2D& dest, Channel channel) {
+	const size_t pixel = (size_t)doubleToIntY(dest.getY()) * to.getWidth() + doubleToIntX(dest.getX());
 
-	double newVal = (valueAt(source, channel) * fit.saturation) + fit.brightness;
-
-	const int d_a = gdImageAlpha(to, gdImageGetPixel(to, d_x, d_y));
-	const int newAlpha = d_a+1;
-
-	if (newAlpha > 1) {
-		const double oldVal = getPixel(to, d_x, d_y, channel, false);
-		newVal = ((oldVal*d_a)+newVal)/(newAlpha);
+	for (unsigned char i = 0; i < getNumComponents(channel); i++) {
+		to.add(pixel, i, (valueAt(source, getComponent(channel, i)) * fit.saturation[i]) + fit.brightness[i]);
 	}
-
-	const int newColor = boundColor(round(newVal));
-
-	setPixel(to, d_x, d_y, newColor, channel, (newAlpha>=gdAlphaTransparent)?gdAlphaTransparent:newAlpha);
+	to.hit(pixel);
 }
 
 // result[P000] is the DOMAIN e.g. the larger triangle
+// For channels with several components the values of each component follow
+// each other, e.g. all of the red values and then all of the green ones.
 map<TriFit::PointMap, vector<double> > DoubleImage::getAllConfigurations(const Triangle* smaller, const Triangle* larger, Channel channel) {
 	map<TriFit::PointMap, vector<double> > result;
 
 	const vector<Point2D>& smallerPoints = getPointsInside(smaller);
+	const unsigned char components = getNumComponents(channel);
 
 	for (char i = 0; i < TriFit::NUM_MAPS; i++) {
 		const TriFit::PointMap m = TriFit::pointMapFromInt(i);
@@ -482,55 +671,107 @@ map<TriFit::PointMap, vector<double> > DoubleImage::getAllConfigurations(const T
 //		const AffineTransform small2large = AffineTransform(*larger, *smaller, m).getInverse();
 		const AffineTransform small2large = AffineTransform(*smaller, *larger, m);
 
-		v.reserve(smallerPoints.size());
+		if (components == 1) {
+			v.reserve(smallerPoints.size());
 
-		for (vector<Point2D>::const_iterator it = smallerPoints.begin(); it != smallerPoints.end(); it++) {
-			v.push_back(valueAt(small2large.transform(*it), channel));
+			for (vector<Point2D>::const_iterator it = smallerPoints.begin(); it != smallerPoints.end(); it++) {
+				v.push_back(valueAt(small2large.transform(*it), channel));
+			}
+		} else {
+			v.resize(smallerPoints.size() * components);
+
+			for (size_t j = 0; j < smallerPoints.size(); j++) {
+				const Point2D p = small2large.transform(smallerPoints[j]);
+				const int color = gdImageTrueColorPixel(image, doubleToIntX(p.getX()), doubleToIntY(p.getY()));
+				for (unsigned char c = 0; c < components; c++) {
+					v[c * smallerPoints.size() + j] = getColor(image, color, getComponent(channel, c));
+				}
+			}
 		}
 	}
 
 	result[TriFit::P000] = vector<double>(0);
 	vector<double>& v = result[TriFit::P000];
 
-	v.reserve(smallerPoints.size());
+	v.reserve(smallerPoints.size() * components);
 
-	for (vector<Point2D>::const_iterator it = smallerPoints.begin(); it != smallerPoints.end(); it++) {
-		v.push_back(valueAt(*it, channel));
+	for (unsigned char c = 0; c < components; c++) {
+		for (vector<Point2D>::const_iterator it = smallerPoints.begin(); it != smallerPoints.end(); it++) {
+			v.push_back(valueAt(*it, getComponent(channel, c)));
+		}
 	}
 
 	return result;
 }
 
+// Shared edges are always scanned in the same direction, so the triangles on
+// both sides of an edge split it at the same point and the scan is only done
+// once.
 double DoubleImage::getBestDivide(const Point2D& first, const Point2D& second, Channel channel) const {
 
 	if (dType == T_MIDDLE) {
 		return .5;
 	}
 
-	bool high = (dType == T_HIGHENTROPY);
-
 	if (!this->hasEdges()) {
 		throw logic_error("Edges not generated!");
 	}
 
-	double initialXDiff = second.getX() - first.getX();
-	double initialYDiff = second.getY() - first.getY();
+	const EdgeKey key(first, second, channel, gdImageSX(image)-1, gdImageSY(image)-1);
+	const bool reversed = key.isReversed();
+	{
+		lock_guard<mutex> guard(divideLock);
+		map<EdgeKey, double>::const_iterator it = divideCache.find(key);
+		if (it != divideCache.end()) {
+			return reversed?1-it->second:it->second;
+		}
+	}
+
+	const double r = reversed?scanEdge(second, first, channel):scanEdge(first, second, channel);
+
+	lock_guard<mutex> guard(divideLock);
+	divideCache[key] = r;
+	return reversed?1-r:r;
+}
+
+// Walks the middle of the edge one pixel at a time along its major axis and
+// returns the ratio of the pixel with the highest (or lowest) edge value
+double DoubleImage::scanEdge(const Point2D& first, const Point2D& second, Channel channel) const {
+	const bool high = (dType == T_HIGHENTROPY);
+	const Channel edgeChannel = (getNumComponents(channel) > 1)?C_GREY:getStorageChannel(channel);
+	const gdImagePtr plane = edges.find(edgeChannel)->second;
+	const int maxX = gdImageSX(image)-1;
+	const int maxY = gdImageSY(image)-1;
 
-	Point2D point1(first.getX() + MIN_SUBDIVIDE_RATIO*(initialXDiff),
-	               first.getY() + MIN_SUBDIVIDE_RATIO*(initialYDiff));
-	Point2D point2(first.getX() + (1-MIN_SUBDIVIDE_RATIO)*(initialXDiff),
-	               first.getY() + (1-MIN_SUBDIVIDE_RATIO)*(initialYDiff));
+	const double initialXDiff = second.getX() - first.getX();
+	const double initialYDiff = second.getY() - first.getY();
 
-	vector<Point2D> points = getPointsOnLine(point1, point2);
+	// Ends of the scan in pixels
+	const double x1 = (first.getX() + MIN_SUBDIVIDE_RATIO*initialXDiff) * maxX;
+	const double y1 = (first.getY() + MIN_SUBDIVIDE_RATIO*initialYDiff) * maxY;
+	const double x2 = (first.getX() + (1-MIN_SUBDIVIDE_RATIO)*initialXDiff) * maxX;
+	const double y2 = (first.getY() + (1-MIN_SUBDIVIDE_RATIO)*initialYDiff) * maxY;
+
+	const bool xMajor = abs(initialXDiff) > abs(initialYDiff);
+	const double a1 = xMajor?x1:y1;
+	const double a2 = xMajor?x2:y2;
+	const double b1 = xMajor?y1:x1;
+	const double b2 = xMajor?y2:x2;
+	const int step = (a2 < a1)?-1:1;
+	const int aStart = (step > 0)?(int)floor(a1):(int)ceil(a1);
+	const int aEnd = (step > 0)?(int)ceil(a2):(int)floor(a2);
 
 	double bestVal = -1;
 	double bestR = -1;
 
-	for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
-		const double val = edgeAt(*it, channel);
+	for (int a = aStart; (step > 0)?(a < aEnd):(a > aEnd); a += step) {
+		const int b = (int)round(b1 + (a - a1) / (a2 - a1) * (b2 - b1));
+		const int x = xMajor?a:b;
+		const int y = xMajor?b:a;
+		const double val = getPixel(plane, min(max(x, 0), maxX), min(max(y, 0), maxY), C_GREY, false);
 		if ( ((high)?(bestVal < val):(bestVal > val)) || bestR < 0) {
-			const double rx = (it->getX() - first.getX())/initialXDiff;
-			const double ry = (it->getY() - first.getY())/initialYDiff;
+			const double rx = ((double)x / maxX - first.getX())/initialXDiff;
+			const double ry = ((double)y / maxY - first.getY())/initialYDiff;
 			double r;
 			if (doublesEqual(initialXDiff, 0)) {
 				r = ry;
@@ -553,6 +794,40 @@ double DoubleImage::getBestDivide(const Point2D& first, const Point2D& second, C
 	}
 }
 
+void DoubleImage::clearDivideCache() {
+	lock_guard<mutex> guard(divideLock);
+	divideCache.clear();
+}
+
+// Endpoints are quantized to a sixteenth of a pixel
+DoubleImage::EdgeKey::EdgeKey(const Point2D& first, const Point2D& second, Channel channel, double scaleX, double scaleY) :
+	channel(channel) {
+	const long long a[2] = {llround(first.getX() * scaleX * 16), llround(first.getY() * scaleY * 16)};
+	const long long b[2] = {llround(second.getX() * scaleX * 16), llround(second.getY() * scaleY * 16)};
+	reversed = (b[0] < a[0]) || (b[0] == a[0] && b[1] < a[1]);
+	coords[0] = reversed?b[0]:a[0];
+	coords[1] = reversed?b[1]:a[1];
+	coords[2] = reversed?a[0]:b[0];
+	coords[3] = reversed?a[1]:b[1];
+}
+
+bool DoubleImage::EdgeKey::isReversed() const {
+	return reversed;
+}
+
+// The direction the edge was given in is not part of the key
+bool DoubleImage::EdgeKey::operator<(const EdgeKey& other) const {
+	if (channel != other.channel) {
+		return channel < other.channel;
+	}
+	for (unsigned char i = 0; i < 4; i++) {
+		if (coords[i] != other.coords[i]) {
+			return coords[i] < other.coords[i];
+		}
+	}
+	return false;
+}
+
 vector<Point2D> DoubleImage::getPointsOnLine(const Point2D& point1, const Point2D& point2) const {
 
 	vector<Point2D> result;
@@ -5,12 +5,15 @@
 #include <vector>
 #include <map>
 #include <iterator>
+#include <mutex>
+#include <utility>
 #include "gd.h"
 
 #include "triangle.h"
 #include "trifit.h"
 #include "point2d.h"
 #include "imageutils.h"
+#include "accumulationbuffer.h"
 
 class DoubleImage {
 public:
@@ -33,16 +36,55 @@ public:
 		M_LAPLACE
 	};
 private:
+	// Sums over a domain's own pixels, which supersampling compares against
+	// every range unchanged
+	struct DomainStats {
+		double sum[TriFit::MAX_COMPONENTS];
+		double squaresSum[TriFit::MAX_COMPONENTS];
+	};
+	typedef std::pair<const Triangle*, Channel> DomainKey;
+	// An edge with its endpoints quantized and put in a fixed order, so the
+	// triangles on either side of it look up the same entry
+	struct EdgeKey {
+		Channel channel;
+		long long coords[4];
+		bool reversed;
+		EdgeKey(const Point2D& first, const Point2D& second, Channel channel, double scaleX, double scaleY);
+		bool isReversed() const;
+		bool operator<(const EdgeKey& other) const;
+	};
+
 	gdImagePtr image;
+	// When decoding part of an image, image only holds the window of a
+	// larger one that starts at windowX, windowY. The grid is always that of
+	// the full image.
+	int windowX;
+	int windowY;
+	int fullWidth;
+	int fullHeight;
 	std::map<Channel, gdImagePtr> edges;
 	std::map<const Triangle*, std::vector<Point2D> > pointsCache;
+	std::map<DomainKey, DomainStats> domainStatsCache;
+	std::mutex domainStatsLock;
+	mutable std::map<EdgeKey, double> divideCache;
+	mutable std::mutex divideLock;
 	SamplingType sType;
 	DivisionType dType;
 	Metric metric;
 	EdgeDetectionMethod edMethod;
 
-	void mapPoint(gdImagePtr to, const TriFit& fit, const Point2D& source, const Point2D& dest, Channel channel);
+	void mapPoint(AccumulationBuffer& to, const TriFit& fit, const Point2D& source, const Point2D& dest, Channel channel);
 	static void copyImage(gdImagePtr* to, gdImagePtr from);
+	double fitComponent(std::vector<double>::const_iterator largerPoints, std::vector<double>::const_iterator smallerPoints,
+	                    std::size_t count, double& s, double& o) const;
+	double fitComponent(std::vector<double>::const_iterator largerPoints, std::vector<double>::const_iterator smallerPoints,
+	                    std::size_t count, double domainSum, double domainSquaresSum, double& s, double& o) const;
+	DomainStats getDomainStats(const Triangle* domain, Channel channel, const std::vector<double>& domainPoints);
+	void clearDomainStats();
+	double scanEdge(const Point2D& first, const Point2D& second, Channel channel) const;
+	void clearDivideCache();
+	double componentError(std::vector<double>::const_iterator largerPoints, std::vector<double>::const_iterator smallerPoints,
+	                      std::size_t count, double s, double o) const;
 public:
 	DoubleImage();
 	DoubleImage(gdImagePtr image);
@@ -53,6 +95,11 @@ public:
 
 	int getWidth() const;
 	int getHeight() const;
+	int getFullWidth() const;
+	int getFullHeight() const;
+	int getWindowX() const;
+	int getWindowY() const;
+	void setWindow(int x, int y, int fullWidth, int fullHeight);
 	Metric getMetric() const;
 	void setMetric(Metric metric);
 	SamplingType getSamplingType() const;
@@ -63,6 +110,7 @@ public:
 	void setEdgeDetectionMethod(EdgeDetectionMethod edMethod);
 	bool hasEdges() const;
 	void setImage(gdImagePtr image);
+	void swapImage(gdImagePtr& image);
 	gdImagePtr getImage() const;
 	void generateEdges();
 	const std::map<Channel, gdImagePtr>& getEdges() const;
@@ -86,10 +134,11 @@ public:
 	const std::vector<Point2D>& getPointsInside(const Triangle* t);
 	std::vector<Point2D> getPointsOnLine(const Point2D& point1, const Point2D& point2) const;
 	TriFit getOptimalFit(const Triangle* smaller, const Triangle* larger, Channel channel);
+	double getFitError(const Triangle* smaller, const TriFit& fit, Channel channel);
 	std::map<TriFit::PointMap, std::vector<double> > getAllConfigurations(const Triangle* smaller, const Triangle* larger, Channel channel);
 	TriFit getBestMatch(const Triangle* smaller, std::list<Triangle*>::const_iterator start, std::list<Triangle*>::const_iterator end, Channel channel);
 	double getBestDivide(const Point2D& point1, const Point2D& point2, Channel channel) const;
-	void mapPoints(const Triangle* t, TriFit fit, gdImagePtr to, Channel channel);
+	void mapPoints(const Triangle* t, TriFit fit, AccumulationBuffer& to, Channel channel);
 
 	static std::vector<Point2D> getCorners();
 };
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "fitcache.h"
+
+using namespace std;
+
+FitCache::Key::Key(const Triangle* t, Channel channel) : channel(channel) {
+	const vector<Point2D>& points = t->getPoints();
+	for (size_t i = 0; i < 3; i++) {
+		coords[2*i] = points[i].getX();
+		coords[2*i+1] = points[i].getY();
+	}
+}
+
+bool FitCache::Key::operator<(const Key& other) const {
+	if (channel != other.channel) {
+		return channel < other.channel;
+	}
+	for (size_t i = 0; i < 6; i++) {
+		if (coords[i] != other.coords[i]) {
+			return coords[i] < other.coords[i];
+		}
+	}
+	return false;
+}
+
+bool FitCache::Key::matches(const Triangle* t) const {
+	const vector<Point2D>& points = t->getPoints();
+	for (size_t i = 0; i < 3; i++) {
+		if (coords[2*i] != points[i].getX() || coords[2*i+1] != points[i].getY()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+FitCache::Entry::Entry(const TriFit& fit, Channel channel) : fit(fit), domain(fit.best, channel) {
+	this->fit.best = NULL;
+}
+
+FitCache::FitCache() : hits(0), misses(0) {
+}
+
+// Only succeeds if the cached domain is also a candidate this time, so a hit
+// is always a fit the search itself could have returned.
+bool FitCache::lookup(const Triangle* t, Channel channel, const list<Triangle*>& domains, TriFit& fit) {
+	map<Key, Entry>::const_iterator it = entries.find(Key(t, channel));
+	if (it != entries.end()) {
+		const Entry& e = it->second;
+		for (list<Triangle*>::const_iterator d = domains.begin(); d != domains.end(); d++) {
+			if (e.domain.matches(*d)) {
+				fit = e.fit;
+				fit.best = *d;
+				hits++;
+				return true;
+			}
+		}
+	}
+	misses++;
+	return false;
+}
+
+void FitCache::store(const Triangle* t, Channel channel, const TriFit& fit) {
+	if (fit.best == NULL || fit.error < 0) {
+		return;
+	}
+	const Key key(t, channel);
+	map<Key, Entry>::iterator it = entries.find(key);
+	if (it != entries.end()) {
+		it->second = Entry(fit, channel);
+	} else {
+		entries.insert(make_pair(key, Entry(fit, channel)));
+	}
+}
+
+size_t FitCache::getSize() const {
+	return entries.size();
+}
+
+size_t FitCache::getHits() const {
+	return hits;
+}
+
+size_t FitCache::getMisses() const {
+	return misses;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FITCACHE_H
+#define _FITCACHE_H
+
+#include <list>
+#include <map>
+#include <cstddef>
+
+#include "triangle.h"
+#include "trifit.h"
+#include "imageutils.h"
+
+// Remembers the best fit found for a triangle across several encodes of the
+// same image. Triangles are identified by their geometry rather than by
+// pointer or id because every encode builds a new tree, but the same
+// subdivision decisions always produce the same corners.
+class FitCache {
+private:
+	struct Key {
+		Channel channel;
+		double coords[6];
+		Key(const Triangle* t, Channel channel);
+		bool operator<(const Key& other) const;
+		bool matches(const Triangle* t) const;
+	};
+	struct Entry {
+		TriFit fit;
+		Key domain;
+		Entry(const TriFit& fit, Channel channel);
+	};
+	std::map<Key, Entry> entries;
+	std::size_t hits;
+	std::size_t misses;
+public:
+	FitCache();
+	bool lookup(const Triangle* t, Channel channel, const std::list<Triangle*>& domains, TriFit& fit);
+	void store(const Triangle* t, Channel channel, const TriFit& fit);
+	std::size_t getSize() const;
+	std::size_t getHits() const;
+	std::size_t getMisses() const;
+};
+
+#endif
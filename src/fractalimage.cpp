@@ -20,6 +20,10 @@
 #include "fractalimage.h"
 
 #include <stdexcept>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
 
 #include "output.h"
 #include "imageutils.h"
@@ -27,7 +31,11 @@
 
 using namespace std;
 
-FractalImage::FractalImage(istream& in, DoubleImage image) : image(image) {
+const unsigned char FractalImage::HAS_THUMBNAIL;
+
+FractalImage::FractalImage(istream& in, DoubleImage image) : image(image), maxTriangles(0), maxBytes(0), chromaScale(DEFAULT_CHROMA_SCALE),
+	checkpointInterval(DEFAULT_CHECKPOINT_INTERVAL), lastCheckpoint(0), currentChannel(0), decoder(DEFAULT_DECODER), decodeOrder(DEFAULT_DECODE_ORDER), threads(1), plan(NULL), backBuffer(NULL),
+	regionX(0), regionY(0), regionWidth(0), regionHeight(0) {
 	if (outputVerbose()) {
 		output << "Loading fractal..." << endl;
 	}
@@ -43,10 +51,26 @@ FractalImage::FractalImage(istream& in, DoubleImage image) : image(image) {
 	metadata = MetaData(in);
 
 	char type = in.get();
+	if (type & HAS_THUMBNAIL) {
+		metadata.unserializeThumbnail(in);
+		type &= ~HAS_THUMBNAIL;
+	}
 
 	if (type == 0) {
 		this->type = T_GREYSCALE;
 		channels.push_back(new TriangleTree(this->image, in, C_GREY));
+	} else if (type == 2) {
+		this->type = T_SHAREDCOLOR;
+		channels.push_back(new TriangleTree(this->image, in, C_RGB));
+	} else if (type == 3) {
+		this->type = T_YCBCR;
+		// Decoding iterates in YCbCr, so the seed needs converting as well
+		if (this->image.getImage() != NULL) {
+			convertToYCbCr(this->image.getImage());
+		}
+		channels.push_back(new TriangleTree(this->image, in, C_Y));
+		channels.push_back(new TriangleTree(this->image, in, C_CB));
+		channels.push_back(new TriangleTree(this->image, in, C_CR));
 	} else {
 		this->type = T_COLOR;
 		channels.push_back(new TriangleTree(this->image, in, C_RED));
@@ -58,7 +82,9 @@ FractalImage::FractalImage(istream& in, DoubleImage image) : image(image) {
 	}
 }
 
-FractalImage::FractalImage(DoubleImage image, ImageType type) : type(type), image(image) {
+FractalImage::FractalImage(DoubleImage image, ImageType type) : type(type), image(image), maxTriangles(0), maxBytes(0), chromaScale(DEFAULT_CHROMA_SCALE),
+	checkpointInterval(DEFAULT_CHECKPOINT_INTERVAL), lastCheckpoint(0), currentChannel(0), decoder(DEFAULT_DECODER), decodeOrder(DEFAULT_DECODE_ORDER), threads(1), plan(NULL), backBuffer(NULL),
+	regionX(0), regionY(0), regionWidth(0), regionHeight(0) {
 	metadata.setWidth(image.getWidth());
 	metadata.setHeight(image.getHeight());
 	switch(type) {
@@ -71,6 +97,15 @@ FractalImage::FractalImage(DoubleImage image, ImageType type) : type(type), imag
 		channels.push_back(new TriangleTree(this->image, C_GREEN));
 		channels.push_back(new TriangleTree(this->image, C_BLUE));
 		break;
+	case T_SHAREDCOLOR:
+		channels.push_back(new TriangleTree(this->image, C_RGB));
+		break;
+	case T_YCBCR:
+		convertToYCbCr(this->image.getImage());
+		channels.push_back(new TriangleTree(this->image, C_Y));
+		channels.push_back(new TriangleTree(this->image, C_CB));
+		channels.push_back(new TriangleTree(this->image, C_CR));
+		break;
 	}
 }
 
@@ -86,45 +121,181 @@ const DoubleImage& FractalImage::getImage() const {
 	return image;
 }
 
+// Returns a new RGB copy of the current image, or of the region if one is
+// set, which the caller must free
+gdImagePtr FractalImage::exportImage() const {
+	if (regionWidth != 0) {
+		gdImagePtr result = gdImageCreateTrueColor(regionWidth, regionHeight);
+		gdImageCopy(result, image.getImage(), 0, 0, regionX, regionY, regionWidth, regionHeight);
+		if (type == T_YCBCR) {
+			convertFromYCbCr(result);
+		}
+		return result;
+	}
+	gdImagePtr result = gdImageCreateTrueColor(image.getWidth(), image.getHeight());
+	gdImageCopy(result, image.getImage(), 0, 0, 0, 0, image.getWidth(), image.getHeight());
+	if (type == T_YCBCR) {
+		convertFromYCbCr(result);
+	}
+	return result;
+}
+
 void FractalImage::serialize(ostream& out) const {
 	out << "FRACTAL";
 
+	serializeHeader(out);
+	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->serialize(out);
+	}
+}
+
+// Everything between the magic and the first channel. A thumbnail follows
+// the type if it has HAS_THUMBNAIL set.
+void FractalImage::serializeHeader(ostream& out) const {
 	metadata.serialize(out);
 
+	const char flags = metadata.hasThumbnail()?HAS_THUMBNAIL:0;
 	switch(type) {
 	default:
 	case T_GREYSCALE:
-		out.put(0);
+		out.put(0 | flags);
 		break;
 	case T_COLOR:
-		out.put(1);
+		out.put(1 | flags);
+		break;
+	case T_SHAREDCOLOR:
+		out.put(2 | flags);
 		break;
+	case T_YCBCR:
+		out.put(3 | flags);
+		break;
+	}
+	if (metadata.hasThumbnail()) {
+		metadata.serializeThumbnail(out);
 	}
+}
+
+size_t FractalImage::getSerializedSize() const {
+	size_t size = getHeaderSize();
 	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
-		(*it)->serialize(out);
+		size += (*it)->getSerializedSize();
 	}
+	return size;
 }
 
+// Returns the next iteration as a new image which the caller must free
 gdImagePtr FractalImage::decode(bool fixErrors) {
 	gdImagePtr newImage = gdImageCreateTrueColor(image.getWidth(), image.getHeight());
 
 	gdImageAlphaBlending(newImage, 0);
 	gdImageSaveAlpha(newImage, 1);
 
-	gdImageFill(newImage, 0, 0, ERROR_COLOR);
-	for (std::vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
-		(*it)->renderTo(newImage, fixErrors);
-	}
+	render(newImage, fixErrors);
 	return newImage;
 }
 
+// Decodes the next iteration into the image, keeping the old one around as
+// the previous image. With D_PINGPONG the two buffers take turns being read
+// from and written to, and the plan keeps its own working space, so once
+// both exist nothing is allocated.
+// D_INPLACE reuses them the same way.
+void FractalImage::iterate(bool fixErrors) {
+	if (decoder == D_DIRECT || decoder == D_COMPILED) {
+		gdImagePtr result = decode(fixErrors);
+		image.swapImage(result);
+		if (backBuffer != NULL) {
+			gdFree(backBuffer);
+		}
+		backBuffer = result;
+		return;
+	}
+	if (backBuffer != NULL && (gdImageSX(backBuffer) != image.getWidth() || gdImageSY(backBuffer) != image.getHeight())) {
+		gdFree(backBuffer);
+		backBuffer = NULL;
+	}
+	if (backBuffer == NULL) {
+		backBuffer = gdImageCreateTrueColor(image.getWidth(), image.getHeight());
+		gdImageAlphaBlending(backBuffer, 0);
+		gdImageSaveAlpha(backBuffer, 1);
+	}
+	render(backBuffer, fixErrors);
+	image.swapImage(backBuffer);
+}
+
+// The image iterate() last decoded from, or NULL if it has not been called
+gdImagePtr FractalImage::getPreviousImage() const {
+	return backBuffer;
+}
+
+// Every pixel of to is written, so it does not need clearing
+void FractalImage::render(gdImagePtr to, bool fixErrors) {
+	if (decoder == D_DIRECT) {
+		for (std::vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+			(*it)->renderTo(to, fixErrors);
+		}
+		return;
+	}
+	// The plan only depends on the trees and the output size, so it is kept
+	// across iterations
+	const bool inPlace = (decoder == D_INPLACE);
+	if (plan == NULL || !plan->matches(image, inPlace, decodeOrder)) {
+		clearPlan();
+		plan = new DecodePlan(channels, image, inPlace, decodeOrder);
+	}
+	if (inPlace) {
+		// The pass reads its own output, so it starts from the current image
+		gdImageCopy(to, image.getImage(), 0, 0, 0, 0, image.getWidth(), image.getHeight());
+		plan->executeInPlace(to, fixErrors);
+	} else {
+		plan->execute(image.getImage(), to, fixErrors, threads);
+	}
+}
+
+FractalImage::Decoder FractalImage::getDecoder() const {
+	return decoder;
+}
+
+void FractalImage::setDecoder(Decoder decoder) {
+	this->decoder = decoder;
+}
+
+DecodePlan::Order FractalImage::getDecodeOrder() const {
+	return decodeOrder;
+}
+
+// Only used by the in place decoder
+void FractalImage::setDecodeOrder(DecodePlan::Order decodeOrder) {
+	this->decodeOrder = decodeOrder;
+}
+
+unsigned int FractalImage::getThreads() const {
+	return threads;
+}
+
+// Used by every decoder but the direct and in place ones
+void FractalImage::setThreads(unsigned int threads) {
+	this->threads = threads;
+}
+
+void FractalImage::clearPlan() {
+	delete plan;
+	plan = NULL;
+}
+
 void FractalImage::encode(double error) {
 	Triangle* cur;
-	for (vector<TriangleTree*>::size_type i = 0; i < channels.size(); i++) {
+	clearPlan();
+	applyBudgets();
+	lastCheckpoint = time(NULL);
+	// Channels before currentChannel are already done when resuming
+	for (vector<TriangleTree*>::size_type i = currentChannel; i < channels.size(); i++) {
+		currentChannel = i;
 		if (outputVerbose()) {
 			output << "Assigning channel " << channelToString(channels[i]->getChannel()) << endl;
 		}
-		while((cur = channels[i]->assignOne(error)) != NULL) {
+		// Chroma carries little detail so it can get away with a looser fit
+		const double cutoff = isChroma(channels[i]->getChannel())?error*chromaScale:error;
+		while((cur = channels[i]->assignOne(cutoff)) != NULL) {
 			if (outputVerbose()) {
 				output << "Triangle #" << cur->getId();
 				output << " assigned - "<< (cur->isTerminal()?"Terminal":"Not Terminal") << endl;
@@ -132,13 +303,300 @@ void FractalImage::encode(double error) {
 				output << channels[i]->getAllTriangles().size() << " total. (";
 				output << (((double)channels[i]->getUnassigned().size())/((double)channels[i]->getAllTriangles().size())*100) << "%)" << endl;
 			}
+			if (!checkpointFilename.empty() && difftime(time(NULL), lastCheckpoint) >= checkpointInterval) {
+				writeCheckpoint(error);
+			}
+		}
+	}
+	currentChannel = 0;
+}
+
+// Budgets are for the whole file so split them evenly between channels. A
+// zero budget means none, so a tight one never rounds down to zero.
+void FractalImage::applyBudgets() {
+	const size_t header = getHeaderSize();
+	for (vector<TriangleTree*>::size_type i = 0; i < channels.size(); i++) {
+		channels[i]->setMaxTriangles((maxTriangles == 0)?0:max(maxTriangles / channels.size(), (size_t)1));
+		if (maxBytes == 0) {
+			channels[i]->setMaxBytes(0);
+		} else if (maxBytes > header) {
+			channels[i]->setMaxBytes(max((maxBytes - header) / channels.size(), (size_t)1));
+		} else {
+			channels[i]->setMaxBytes(1);
+		}
+	}
+}
+
+// Seeds every channel from the same channel of previous, the fractal of the
+// previous frame, so that encode() only has to refine what changed. Returns
+// false if any channel has moved too far from previous to be worth it, in
+// which case the trees are left half inherited and the frame has to be
+// encoded by a fresh FractalImage instead.
+bool FractalImage::inherit(const FractalImage& previous, double error) {
+	if (previous.type != type || previous.image.getWidth() != image.getWidth() ||
+	    previous.image.getHeight() != image.getHeight()) {
+		throw logic_error("FRAMES DO NOT MATCH");
+	}
+	clearPlan();
+	applyBudgets();
+	for (vector<TriangleTree*>::size_type i = 0; i < channels.size(); i++) {
+		const double cutoff = isChroma(channels[i]->getChannel())?error*chromaScale:error;
+		if (!channels[i]->inherit(*previous.channels[i], cutoff)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FractalImage::setCheckpoint(string filename, double interval) {
+	checkpointFilename = filename;
+	checkpointInterval = interval;
+}
+
+// Written to a temporary file first so that a crash part way through a write
+// never clobbers the previous checkpoint
+void FractalImage::writeCheckpoint(double error) {
+	const string temp = checkpointFilename + ".tmp";
+	ofstream out(temp.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+	if (!out.good()) {
+		openError(temp);
+		return;
+	}
+	saveState(out, error);
+	out.close();
+	if (out.fail() || rename(temp.c_str(), checkpointFilename.c_str()) != 0) {
+		if (outputError()) {
+			output << "Could not write checkpoint " << checkpointFilename << "." << endl;
+		}
+		return;
+	}
+	if (outputVerbose()) {
+		output << "Checkpoint written to " << checkpointFilename << "." << endl;
+	}
+	lastCheckpoint = time(NULL);
+}
+
+void FractalImage::saveState(ostream& out, double error) const {
+	out << "FSTA";
+	out.put(type | (metadata.hasThumbnail()?HAS_THUMBNAIL:0));
+	metadata.serialize(out);
+	if (metadata.hasThumbnail()) {
+		metadata.serializeThumbnail(out);
+	}
+	serializeDouble(out, error);
+	serializeDouble(out, chromaScale);
+	serializeSignedInt(out, maxTriangles);
+	serializeSignedInt(out, maxBytes);
+	out.put(channels.front()->getSubdivisionMethod());
+	out.put(channels.front()->getSubdivisionOrder());
+	out.put(image.getSamplingType());
+	out.put(image.getDivisionType());
+	out.put(image.getMetric());
+	out.put(image.getEdgeDetectionMethod());
+	out.put(currentChannel);
+	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->saveState(out);
+	}
+}
+
+// The options the encode was started with take precedence over whatever the
+// image was set up with, otherwise the result would not match.
+FractalImage* FractalImage::loadState(istream& in, DoubleImage image, double& error) {
+	char magic[5];
+	in.read(magic, 4);
+	magic[4] = '\0';
+	if (!(string("FSTA") == magic)) {
+		throw logic_error("NOT VALID CHECKPOINT");
+	}
+
+	const unsigned char typeByte = in.get();
+	const ImageType type = (ImageType)(typeByte & ~HAS_THUMBNAIL);
+	MetaData metadata(in);
+	if (typeByte & HAS_THUMBNAIL) {
+		metadata.unserializeThumbnail(in);
+	}
+	error = unserializeDouble(in);
+	const double chromaScale = unserializeDouble(in);
+	const size_t maxTriangles = unserializeSignedInt(in);
+	const size_t maxBytes = unserializeSignedInt(in);
+	const TriangleTree::SubdivisionMethod sMethod = (TriangleTree::SubdivisionMethod)in.get();
+	const TriangleTree::SubdivisionOrder sOrder = (TriangleTree::SubdivisionOrder)in.get();
+	image.setSamplingType((DoubleImage::SamplingType)in.get());
+	image.setDivisionType((DoubleImage::DivisionType)in.get());
+	image.setMetric((DoubleImage::Metric)in.get());
+	image.setEdgeDetectionMethod((DoubleImage::EdgeDetectionMethod)in.get());
+	const unsigned char currentChannel = in.get();
+
+	FractalImage* fractal = new FractalImage(image, type);
+	fractal->metadata = metadata;
+	fractal->setChromaScale(chromaScale);
+	fractal->setMaxTriangles(maxTriangles);
+	fractal->setMaxBytes(maxBytes);
+	fractal->setSubdivisionMethod(sMethod);
+	fractal->setSubdivisionOrder(sOrder);
+	fractal->currentChannel = currentChannel;
+	try {
+		for (vector<TriangleTree*>::iterator it = fractal->channels.begin(); it != fractal->channels.end(); it++) {
+			(*it)->loadState(in);
+		}
+	} catch (...) {
+		delete fractal;
+		throw;
+	}
+	return fractal;
+}
+
+// Stores the image being encoded, shrunk to at most maxSize pixels on its
+// longer side, so decoders can start from it instead of noise
+void FractalImage::setThumbnail(int maxSize) {
+	metadata.setThumbnail(image.getImage(), maxSize, type == T_GREYSCALE);
+}
+
+// Replaces the image with the thumbnail scaled up to its size. Returns false
+// if there is no thumbnail.
+bool FractalImage::seedFromThumbnail() {
+	if (!metadata.hasThumbnail()) {
+		return false;
+	}
+	gdImagePtr thumbnail = metadata.getThumbnail();
+	gdImagePtr seed = scaleBilinear(thumbnail, image.getWidth(), image.getHeight());
+	image.setImage(seed);
+	if (plan != NULL) {
+		plan->forgetSource();
+	}
+	gdFree(seed);
+	gdFree(thumbnail);
+	return true;
+}
+
+// Decodes a preview from the top of the trees only, cutting them at
+// maxDepth (if it is not negative) and above triangles smaller than minArea.
+// The triangles at the cut are fitted to a decode of the whole trees, run
+// from the current image at just enough pixels for the smallest of them
+// (LOD_FIT_POINTS) but no more than 1/LOD_FIT_DIVISOR of the size across,
+// and the preview then starts from that decode scaled up. Since that is
+// already close, the preview only needs a few iterations. Returns the number
+// of pixels of that decode, or zero if no triangle needed fitting.
+// Has to come before setRegion(), which works from the triangles decoded.
+size_t FractalImage::setDetailLimit(int maxDepth, double minArea) {
+	double smallest = HUGE_VAL;
+	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->clearDetailLimit();
+		smallest = min(smallest, (*it)->getSmallestCut(maxDepth, minArea));
+	}
+	clearPlan();
+
+	const int width = image.getWidth();
+	const int height = image.getHeight();
+	size_t fitPixels = 0;
+	if (smallest != HUGE_VAL) {
+		const double scale = min(sqrt(LOD_FIT_POINTS / (smallest * width * height)), 1.0 / LOD_FIT_DIVISOR);
+		const int fitWidth = max((int)(width * scale + 0.5), 1);
+		const int fitHeight = max((int)(height * scale + 0.5), 1);
+		fitPixels = (size_t)fitWidth * fitHeight;
+		if (outputVerbose()) {
+			output << "Fitting the cut to a " << fitWidth << "x" << fitHeight << " decode..." << endl;
+		}
+		gdImagePtr small = scaleBilinear(image.getImage(), fitWidth, fitHeight);
+		image.setImage(small);
+		gdFree(small);
+		for (int i = 0; i < LOD_FIT_ITERATIONS; i++) {
+			iterate(true);
+		}
+		clearPlan();
+		if (backBuffer != NULL) {
+			gdFree(backBuffer);
+			backBuffer = NULL;
+		}
+	}
+
+	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->setDetailLimit(maxDepth, minArea);
+	}
+
+	if (smallest != HUGE_VAL) {
+		gdImagePtr seed = scaleBilinear(image.getImage(), width, height);
+		image.setImage(seed);
+		gdFree(seed);
+	}
+	return fitPixels;
+}
+
+// Limits decoding to the width by height pixels at x, y of the current
+// image and the triangles they depend on. The image is cropped to the
+// bounding box of those triangles, so iterations only cost as much as that
+// window rather than the whole image, and exportImage() returns just the
+// region. The pixels in the region come out the same as in a full decode,
+// although D_INPLACE may order the triangles differently when only some of
+// them are needed.
+void FractalImage::setRegion(int x, int y, int width, int height) {
+	if (image.getWidth() != image.getFullWidth() || image.getHeight() != image.getFullHeight()) {
+		throw logic_error("region is already set");
+	}
+	const int fullWidth = image.getWidth();
+	const int fullHeight = image.getHeight();
+	// Only the part of the region inside the image is decoded
+	const long long endX = min((long long)x + width, (long long)fullWidth);
+	const long long endY = min((long long)y + height, (long long)fullHeight);
+	x = max(x, 0);
+	y = max(y, 0);
+	if (endX <= x || endY <= y) {
+		throw logic_error("region is outside the image");
+	}
+	width = endX - x;
+	height = endY - y;
+
+	const double xInc = image.getXInc();
+	const double yInc = image.getYInc();
+	const Rectangle region(x * xInc, y * yInc, (width - 1) * xInc, (height - 1) * yInc);
+	double left = region.getLeft();
+	double top = region.getTop();
+	double right = region.getRight();
+	double bottom = region.getBottom();
+	for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->setDecodeRegion(region, REGION_MARGIN * xInc, REGION_MARGIN * yInc);
+		const vector<Triangle*> triangles = (*it)->getDecodeTriangles();
+		for (vector<Triangle*>::const_iterator t = triangles.begin(); t != triangles.end(); t++) {
+			const Rectangle bounds = (*t)->getBoundingBox();
+			left = min(left, bounds.getLeft());
+			top = min(top, bounds.getTop());
+			right = max(right, bounds.getRight());
+			bottom = max(bottom, bounds.getBottom());
 		}
 	}
 
+	// A pixel either way for the rounding
+	const int windowX = max((int)floor(left / xInc) - 1, 0);
+	const int windowY = max((int)floor(top / yInc) - 1, 0);
+	const int windowWidth = min((int)ceil(right / xInc) + 2, fullWidth) - windowX;
+	const int windowHeight = min((int)ceil(bottom / yInc) + 2, fullHeight) - windowY;
+	gdImagePtr window = gdImageCreateTrueColor(windowWidth, windowHeight);
+	gdImageCopy(window, image.getImage(), 0, 0, windowX, windowY, windowWidth, windowHeight);
+	image.setImage(window);
+	gdFree(window);
+	image.setWindow(windowX, windowY, fullWidth, fullHeight);
+	if (outputVerbose()) {
+		output << "Decoding a " << windowWidth << "x" << windowHeight << " window of the " << fullWidth << "x" <<
+		          fullHeight << " image." << endl;
+	}
+
+	regionX = x - windowX;
+	regionY = y - windowY;
+	regionWidth = width;
+	regionHeight = height;
+	clearPlan();
+	if (backBuffer != NULL) {
+		gdFree(backBuffer);
+		backBuffer = NULL;
+	}
 }
 
 void FractalImage::setImage(DoubleImage image) {
 	this->image = image;
+	// The plan would carry on from the values it wrote last
+	if (plan != NULL) {
+		plan->forgetSource();
+	}
 }
 
 vector<Triangle*>::size_type FractalImage::getSize() const {
@@ -150,6 +608,10 @@ vector<Triangle*>::size_type FractalImage::getSize() const {
 }
 
 FractalImage::~FractalImage() {
+	clearPlan();
+	if (backBuffer != NULL) {
+		gdFree(backBuffer);
+	}
 	for (vector<TriangleTree*>::iterator it = channels.begin(); it != channels.end(); it++) {
 		delete *it;
 	}
@@ -164,3 +626,44 @@ void FractalImage::setSubdivisionMethod(TriangleTree::SubdivisionMethod sMethod)
 		(*it)->setSubdivisionMethod(sMethod);
 	}
 }
+
+void FractalImage::setSubdivisionOrder(TriangleTree::SubdivisionOrder sOrder) {
+	for (vector<TriangleTree*>::iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->setSubdivisionOrder(sOrder);
+	}
+}
+
+size_t FractalImage::getMaxTriangles() const {
+	return maxTriangles;
+}
+
+void FractalImage::setMaxTriangles(size_t maxTriangles) {
+	this->maxTriangles = maxTriangles;
+}
+
+size_t FractalImage::getMaxBytes() const {
+	return maxBytes;
+}
+
+void FractalImage::setMaxBytes(size_t maxBytes) {
+	this->maxBytes = maxBytes;
+}
+
+void FractalImage::setFitCache(FitCache* fitCache) {
+	for (vector<TriangleTree*>::iterator it = channels.begin(); it != channels.end(); it++) {
+		(*it)->setFitCache(fitCache);
+	}
+}
+
+double FractalImage::getChromaScale() const {
+	return chromaScale;
+}
+
+void FractalImage::setChromaScale(double chromaScale) {
+	this->chromaScale = chromaScale;
+}
+
+// Size of everything serialize() writes before the first channel
+size_t FractalImage::getHeaderSize() const {
+	return 7 + metadata.getSerializedSize() + 1 + metadata.getThumbnailSize();
+}
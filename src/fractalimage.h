@@ -21,6 +21,8 @@
 #define _FRACTALIMAGE_H
 
 #include <vector>
+#include <string>
+#include <ctime>
 #include <istream>
 #include <ostream>
 #include "gd.h"
@@ -29,31 +31,92 @@
 #include "doubleimage.h"
 #include "triangle.h"
 #include "metadata.h"
+#include "decodeplan.h"
 
 class FractalImage {
 public:
 	enum ImageType {
 		T_GREYSCALE,
-		T_COLOR
+		T_COLOR,
+		T_SHAREDCOLOR,
+		T_YCBCR
 	};
+	enum Decoder {
+		D_DIRECT,
+		D_COMPILED,
+		D_PINGPONG,
+		D_INPLACE
+	};
+	// Set on the stored type when a thumbnail follows it
+	static const unsigned char HAS_THUMBNAIL = 0x80;
 private:
 	ImageType type;
 	DoubleImage image;
 	std::vector<TriangleTree*> channels;
 	MetaData metadata;
+	std::size_t maxTriangles;
+	std::size_t maxBytes;
+	double chromaScale;
+	std::string checkpointFilename;
+	double checkpointInterval;
+	std::time_t lastCheckpoint;
+	std::vector<TriangleTree*>::size_type currentChannel;
+	Decoder decoder;
+	DecodePlan::Order decodeOrder;
+	unsigned int threads;
+	DecodePlan* plan;
+	gdImagePtr backBuffer;
+	// The part of the image exportImage() returns if regionWidth is set
+	int regionX;
+	int regionY;
+	int regionWidth;
+	int regionHeight;
+
+	void applyBudgets();
+	void clearPlan();
+	void render(gdImagePtr to, bool fixErrors);
+	void writeCheckpoint(double error);
 public:
 	FractalImage(std::istream& in, DoubleImage image);
 	FractalImage(DoubleImage image, ImageType type);
 	const DoubleImage& getImage() const;
+	gdImagePtr exportImage() const;
 	void setImage(DoubleImage image);
+	void setThumbnail(int maxSize);
+	bool seedFromThumbnail();
+	std::size_t setDetailLimit(int maxDepth, double minArea);
+	void setRegion(int x, int y, int width, int height);
 	ImageType getType() const;
 	std::vector<Triangle*>::size_type getSize() const;
 	const std::vector<TriangleTree*>& getChannels() const;
 	MetaData& getMetadata();
 	void serialize(std::ostream& out) const;
+	void serializeHeader(std::ostream& out) const;
+	std::size_t getSerializedSize() const;
 	void encode(double error);
+	bool inherit(const FractalImage& previous, double error);
 	void setSubdivisionMethod(TriangleTree::SubdivisionMethod sMethod);
+	void setSubdivisionOrder(TriangleTree::SubdivisionOrder sOrder);
+	std::size_t getMaxTriangles() const;
+	void setMaxTriangles(std::size_t maxTriangles);
+	std::size_t getMaxBytes() const;
+	void setMaxBytes(std::size_t maxBytes);
+	std::size_t getHeaderSize() const;
+	void setFitCache(FitCache* fitCache);
+	double getChromaScale() const;
+	void setChromaScale(double chromaScale);
+	void setCheckpoint(std::string filename, double interval);
+	void saveState(std::ostream& out, double error) const;
+	static FractalImage* loadState(std::istream& in, DoubleImage image, double& error);
+	Decoder getDecoder() const;
+	void setDecoder(Decoder decoder);
+	DecodePlan::Order getDecodeOrder() const;
+	void setDecodeOrder(DecodePlan::Order decodeOrder);
+	unsigned int getThreads() const;
+	void setThreads(unsigned int threads);
 	gdImagePtr decode(bool fixErrors);
+	void iterate(bool fixErrors);
+	gdImagePtr getPreviousImage() const;
 	~FractalImage();
 };
 
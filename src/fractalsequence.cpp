@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "fractalsequence.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "ioutils.h"
+#include "imageutils.h"
+
+using namespace std;
+
+// Reads one triangle as written by Triangle::serialize()
+static string readRecord(istream& in, unsigned char components, unsigned char idSize) {
+	const size_t fixed = Triangle::getSerializedSize(0, components, idSize) - TriFit::getSerializedSize(components, idSize);
+	string record(fixed, '\0');
+	in.read(&record[0], fixed);
+	const size_t numChildren = (unsigned char)record[fixed - 1];
+	const size_t rest = Triangle::getSerializedSize(numChildren, components, idSize) - fixed;
+	record.resize(fixed + rest);
+	in.read(&record[fixed], rest);
+	if (!in.good()) {
+		throw logic_error("NOT VALID SEQUENCE FILE");
+	}
+	return record;
+}
+
+static unsigned int getRecordId(const string& record, unsigned char idSize) {
+	unsigned int id = 0;
+	for (unsigned char i = 0; i < idSize; i++) {
+		id = (id << 8) | (unsigned char)record[i];
+	}
+	return id;
+}
+
+// Returns the id size of the chunk, shortMagic having 16 bit ids and
+// longMagic 32 bit ones
+static unsigned char readMagic(istream& in, const char* shortMagic, const char* longMagic) {
+	char magic[5];
+	in.read(magic, 4);
+	magic[4] = '\0';
+	if (string(shortMagic) == magic) {
+		return Triangle::SHORT_IDS;
+	} else if (string(longMagic) == magic) {
+		return Triangle::LONG_IDS;
+	}
+	throw logic_error("NOT VALID SEQUENCE FILE");
+}
+
+static unsigned int readCount(istream& in, unsigned char idSize) {
+	return (idSize == Triangle::SHORT_IDS)?unserializeUnsignedShort(in):unserializeSignedInt(in);
+}
+
+static void writeCount(ostream& out, unsigned int count, unsigned char idSize) {
+	if (idSize == Triangle::SHORT_IDS) {
+		serializeUnsignedShort(out, count);
+	} else {
+		serializeSignedInt(out, count);
+	}
+}
+
+SequenceWriter::SequenceWriter(ostream& out) : out(out), numFrames(0) {
+}
+
+// Returns the number of bytes written for the frame. The first frame is
+// always a key frame.
+size_t SequenceWriter::write(const FractalImage& fractal, bool keyFrame) {
+	const vector<TriangleTree*>& channels = fractal.getChannels();
+	const streampos start = out.tellp();
+	if (numFrames == 0) {
+		out << "FRACSEQ";
+		fractal.serializeHeader(out);
+		out.put(channels.size());
+		for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+			out.put(getNumComponents((*it)->getChannel()));
+		}
+	}
+
+	vector<vector<string> > current(channels.size());
+	for (vector<TriangleTree*>::size_type i = 0; i < channels.size(); i++) {
+		channels[i]->getRecords(current[i]);
+	}
+
+	if (numFrames == 0 || keyFrame) {
+		out.put('K');
+		for (vector<TriangleTree*>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+			(*it)->serialize(out);
+		}
+	} else {
+		out.put('D');
+		for (vector<TriangleTree*>::size_type i = 0; i < channels.size(); i++) {
+			const vector<string>& previous = records[i];
+			vector<const string*> changed;
+			for (vector<string>::size_type id = 0; id < current[i].size(); id++) {
+				if (id >= previous.size() || previous[id] != current[i][id]) {
+					changed.push_back(&current[i][id]);
+				}
+			}
+			// A change of id size changes every record, so the whole tree is sent
+			const unsigned char idSize = channels[i]->getIdSize();
+			out << ((idSize == Triangle::SHORT_IDS)?"TDLT":"TDL4");
+			writeCount(out, current[i].size(), idSize);
+			writeCount(out, changed.size(), idSize);
+			for (vector<const string*>::const_iterator it = changed.begin(); it != changed.end(); it++) {
+				out << **it;
+			}
+		}
+	}
+
+	records.swap(current);
+	numFrames++;
+	return out.tellp() - start;
+}
+
+size_t SequenceWriter::getNumFrames() const {
+	return numFrames;
+}
+
+SequenceReader::SequenceReader(istream& in) : in(in) {
+	char magic[8];
+	in.read(magic, 7);
+	magic[7] = '\0';
+	if (!(string("FRACSEQ") == magic)) {
+		throw logic_error("NOT VALID SEQUENCE FILE");
+	}
+
+	ostringstream headerStream(ios_base::out|ios_base::binary);
+	MetaData metadata(in);
+	const char type = in.get();
+	if (type & FractalImage::HAS_THUMBNAIL) {
+		metadata.unserializeThumbnail(in);
+	}
+	metadata.serialize(headerStream);
+	headerStream.put(type);
+	if (type & FractalImage::HAS_THUMBNAIL) {
+		metadata.serializeThumbnail(headerStream);
+	}
+	header = headerStream.str();
+
+	const unsigned char numChannels = in.get();
+	for (unsigned char i = 0; i < numChannels; i++) {
+		components.push_back(in.get());
+	}
+	records.resize(numChannels);
+	idSizes.resize(numChannels, Triangle::SHORT_IDS);
+	if (!in.good()) {
+		throw logic_error("NOT VALID SEQUENCE FILE");
+	}
+}
+
+bool SequenceReader::isSequence(istream& in) {
+	char magic[8];
+	in.read(magic, 7);
+	magic[7] = '\0';
+	const bool result = in.good() && string("FRACSEQ") == magic;
+	in.clear();
+	in.seekg(0, ios::beg);
+	return result;
+}
+
+// Writes the next frame to fractal in the format FractalImage reads, or
+// returns false at the end of the sequence
+bool SequenceReader::next(ostream& fractal) {
+	const int type = in.get();
+	if (type == EOF) {
+		return false;
+	}
+
+	for (vector<vector<string> >::size_type i = 0; i < records.size(); i++) {
+		if (type == 'K') {
+			idSizes[i] = readMagic(in, "TREE", "TRE4");
+			records[i].resize(readCount(in, idSizes[i]));
+			for (vector<string>::size_type j = 0; j < records[i].size(); j++) {
+				const string record = readRecord(in, components[i], idSizes[i]);
+				records[i].at(getRecordId(record, idSizes[i])) = record;
+			}
+		} else if (type == 'D') {
+			idSizes[i] = readMagic(in, "TDLT", "TDL4");
+			records[i].resize(readCount(in, idSizes[i]));
+			const unsigned int numChanged = readCount(in, idSizes[i]);
+			for (unsigned int j = 0; j < numChanged; j++) {
+				const string record = readRecord(in, components[i], idSizes[i]);
+				records[i].at(getRecordId(record, idSizes[i])) = record;
+			}
+		} else {
+			throw logic_error("NOT VALID SEQUENCE FILE");
+		}
+	}
+
+	fractal << "FRACTAL" << header;
+	for (vector<vector<string> >::size_type i = 0; i < records.size(); i++) {
+		fractal << ((idSizes[i] == Triangle::SHORT_IDS)?"TREE":"TRE4");
+		writeCount(fractal, records[i].size(), idSizes[i]);
+		for (vector<string>::const_iterator record = records[i].begin(); record != records[i].end(); record++) {
+			fractal << *record;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FRACTALSEQUENCE_H
+#define _FRACTALSEQUENCE_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+#include "fractalimage.h"
+
+// A sequence is the header of the first fractal followed by one chunk per
+// frame. The first frame, and any later key frame, is stored in full and
+// every other one only holds the triangles whose serialized form changed,
+// keyed by their id.
+class SequenceWriter {
+private:
+	std::ostream& out;
+	std::vector<std::vector<std::string> > records;
+	std::size_t numFrames;
+public:
+	SequenceWriter(std::ostream& out);
+	std::size_t write(const FractalImage& fractal, bool keyFrame = false);
+	std::size_t getNumFrames() const;
+};
+
+class SequenceReader {
+private:
+	std::istream& in;
+	std::string header;
+	std::vector<unsigned char> components;
+	std::vector<unsigned char> idSizes;
+	std::vector<std::vector<std::string> > records;
+public:
+	SequenceReader(std::istream& in);
+	bool next(std::ostream& fractal);
+
+	static bool isSequence(std::istream& in);
+};
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "framesource.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "imageutils.h"
+#include "output.h"
+
+using namespace std;
+
+static bool hasExtension(const string& name, const string& ext) {
+	if (name.size() < ext.size()) {
+		return false;
+	}
+	string end = name.substr(name.size() - ext.size());
+	transform(end.begin(), end.end(), end.begin(), ::tolower);
+	return end == ext;
+}
+
+static bool isDirectory(const string& path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+FrameSource::FrameSource(const string& path) : nextFile(0), width(0), height(0), format(F_420) {
+	if (isDirectory(path)) {
+		openDirectory(path);
+	} else {
+		openY4M(path);
+	}
+}
+
+bool FrameSource::isSequence(const string& path) {
+	return isDirectory(path) || hasExtension(path, ".y4m");
+}
+
+void FrameSource::openDirectory(const string& path) {
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL) {
+		throw runtime_error("Could not open directory.");
+	}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		const string name(entry->d_name);
+		if (hasExtension(name, ".png") || hasExtension(name, ".jpg") || hasExtension(name, ".jpeg")) {
+			files.push_back(path + "/" + name);
+		}
+	}
+	closedir(dir);
+	sort(files.begin(), files.end());
+	if (files.empty()) {
+		throw runtime_error("No png or jpeg frames in directory.");
+	}
+}
+
+void FrameSource::openY4M(const string& path) {
+	stream.open(path.c_str(), ios_base::in | ios_base::binary);
+	if (!stream.good()) {
+		throw runtime_error("Could not open file for reading.");
+	}
+	string header;
+	getline(stream, header);
+	istringstream params(header);
+	string param;
+	params >> param;
+	if (param != "YUV4MPEG2") {
+		throw runtime_error("Not a YUV4MPEG2 stream.");
+	}
+	while (params >> param) {
+		const string value = param.substr(1);
+		switch (param[0]) {
+		case 'W':
+			width = atoi(value.c_str());
+			break;
+		case 'H':
+			height = atoi(value.c_str());
+			break;
+		case 'C':
+			if (value == "420" || value == "420jpeg" || value == "420paldv" || value == "420mpeg2") {
+				format = F_420;
+			} else if (value == "422") {
+				format = F_422;
+			} else if (value == "444") {
+				format = F_444;
+			} else if (value == "mono") {
+				format = F_MONO;
+			} else {
+				throw runtime_error("Unsupported YUV4MPEG2 colour space.");
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if (width <= 0 || height <= 0) {
+		throw runtime_error("YUV4MPEG2 stream has no size.");
+	}
+}
+
+gdImagePtr FrameSource::next() {
+	if (stream.is_open()) {
+		return readY4MFrame();
+	}
+	if (nextFile == files.size()) {
+		return NULL;
+	}
+	return loadImage(files[nextFile++].c_str());
+}
+
+// Frames are studio range BT.601, chroma is sampled from the nearest sample
+gdImagePtr FrameSource::readY4MFrame() {
+	string frameHeader;
+	if (!getline(stream, frameHeader)) {
+		return NULL;
+	}
+	if (frameHeader.compare(0, 5, "FRAME") != 0) {
+		throw runtime_error("Bad YUV4MPEG2 frame header.");
+	}
+
+	int cw = 0;
+	int ch = 0;
+	switch (format) {
+	case F_420:
+		cw = (width + 1) / 2;
+		ch = (height + 1) / 2;
+		break;
+	case F_422:
+		cw = (width + 1) / 2;
+		ch = height;
+		break;
+	case F_444:
+		cw = width;
+		ch = height;
+		break;
+	case F_MONO:
+		break;
+	}
+	const size_t lumaSize = (size_t)width * height;
+	const size_t chromaSize = (size_t)cw * ch;
+	planes.resize(lumaSize + 2 * chromaSize);
+	stream.read((char*)&planes[0], planes.size());
+	if ((size_t)stream.gcount() != planes.size()) {
+		throw runtime_error("Truncated YUV4MPEG2 frame.");
+	}
+
+	const unsigned char* luma = &planes[0];
+	const unsigned char* cb = luma + lumaSize;
+	const unsigned char* cr = cb + chromaSize;
+
+	gdImagePtr frame = gdImageCreateTrueColor(width, height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const double l = 1.164 * (luma[y * width + x] - 16);
+			double u = 0;
+			double v = 0;
+			if (format != F_MONO) {
+				const int c = (y * ch / height) * cw + (x * cw / width);
+				u = cb[c] - 128;
+				v = cr[c] - 128;
+			}
+			const unsigned char r = boundColor((int)round(l + 1.596 * v));
+			const unsigned char g = boundColor((int)round(l - 0.392 * u - 0.813 * v));
+			const unsigned char b = boundColor((int)round(l + 2.017 * u));
+			gdImageSetPixel(frame, x, y, gdTrueColor(r, g, b));
+		}
+	}
+	return frame;
+}
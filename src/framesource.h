@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FRAMESOURCE_H
+#define _FRAMESOURCE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstddef>
+#include "gd.h"
+
+// Reads the frames of a sequence, either the images in a directory (in name
+// order) or a raw YUV4MPEG2 stream.
+class FrameSource {
+public:
+	enum ChromaFormat {
+		F_420,
+		F_422,
+		F_444,
+		F_MONO
+	};
+private:
+	std::vector<std::string> files;
+	std::vector<std::string>::size_type nextFile;
+	std::ifstream stream;
+	int width;
+	int height;
+	ChromaFormat format;
+	std::vector<unsigned char> planes;
+
+	void openDirectory(const std::string& path);
+	void openY4M(const std::string& path);
+	gdImagePtr readY4MFrame();
+public:
+	FrameSource(const std::string& path);
+	gdImagePtr next();
+
+	static bool isSequence(const std::string& path);
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include "imageutils.h"
 
 #include <cmath>
+#include <algorithm>
 #include <random>
 #include <cstdio>
 #include <stdexcept>
@@ -92,7 +93,7 @@ unsigned char getGrey(const gdImagePtr img, int c) {
 }
 
 unsigned char getColor(const gdImagePtr img, int c, Channel channel) {
-	switch(channel) {
+	switch(getStorageChannel(channel)) {
 	default:
 	case C_GREY:
 		return getGrey(img, c);
@@ -121,7 +122,7 @@ unsigned char getPixel(const gdImagePtr img, int x, int y, Channel channel, bool
 
 void setPixel(gdImagePtr img, int x, int y, unsigned char value, Channel channel, unsigned char alpha) {
 	int c;
-	switch(channel) {
+	switch(getStorageChannel(channel)) {
 	default:
 	case C_GREY:
 		c = gdTrueColorAlpha(value, value, value, alpha);
@@ -142,6 +143,16 @@ void setPixel(gdImagePtr img, int x, int y, unsigned char value, Channel channel
 	gdImageSetPixel(img, x, y, c);
 }
 
+// Marks a pixel nothing was decoded onto. Other components of the pixel are
+// left alone, unless channel is grey and so covers all of them.
+void setErrorPixel(gdImagePtr img, int x, int y, Channel channel) {
+	if (getStorageChannel(channel) == C_GREY) {
+		gdImageSetPixel(img, x, y, ERROR_COLOR);
+	} else {
+		setPixel(img, x, y, getColor(img, ERROR_COLOR, channel), channel);
+	}
+}
+
 gdImagePtr edgeDetect(const gdImagePtr image, int op(const unsigned char*), Channel channel) {
 	gdImagePtr result = gdImageCreateTrueColor(gdImageSX(image), gdImageSY(image));
 
@@ -167,15 +178,52 @@ gdImagePtr edgeDetect(const gdImagePtr image, int op(const unsigned char*), Chan
 	return result;
 }
 
-void clearAlpha(gdImagePtr img) {
-	for (int x = 0; x < gdImageSX(img); x++) {
-		for (int y = 0; y < gdImageSY(img); y++) {
-			int oldC = gdImageGetPixel(img, x, y);
-			gdImageSetPixel(img, x, y, gdTrueColorAlpha(gdImageRed(img, oldC),
-			                gdImageGreen(img, oldC), gdImageBlue(img, oldC),
-			                gdAlphaOpaque));
+// Returns a new image of img resized to width x height with bilinear
+// interpolation, which the caller must free. Unlike gdImageCopyResampled()
+// this stays smooth when enlarging a very small image.
+gdImagePtr scaleBilinear(const gdImagePtr img, int width, int height) {
+	gdImagePtr result = gdImageCreateTrueColor(width, height);
+	const int srcWidth = gdImageSX(img);
+	const int srcHeight = gdImageSY(img);
+	for (int y = 0; y < height; y++) {
+		const double sy = max(0.0, min(srcHeight - 1.0, (y + 0.5) * srcHeight / height - 0.5));
+		const int y0 = (int)sy;
+		const int y1 = min(y0 + 1, srcHeight - 1);
+		const double fy = sy - y0;
+		for (int x = 0; x < width; x++) {
+			const double sx = max(0.0, min(srcWidth - 1.0, (x + 0.5) * srcWidth / width - 0.5));
+			const int x0 = (int)sx;
+			const int x1 = min(x0 + 1, srcWidth - 1);
+			const double fx = sx - x0;
+			const int c00 = gdImageTrueColorPixel(img, x0, y0);
+			const int c10 = gdImageTrueColorPixel(img, x1, y0);
+			const int c01 = gdImageTrueColorPixel(img, x0, y1);
+			const int c11 = gdImageTrueColorPixel(img, x1, y1);
+			unsigned char value[3];
+			const Channel channels[3] = {C_RED, C_GREEN, C_BLUE};
+			for (int i = 0; i < 3; i++) {
+				const double top = getColor(img, c00, channels[i]) * (1 - fx) + getColor(img, c10, channels[i]) * fx;
+				const double bottom = getColor(img, c01, channels[i]) * (1 - fx) + getColor(img, c11, channels[i]) * fx;
+				value[i] = boundColor(round(top * (1 - fy) + bottom * fy));
+			}
+			gdImageSetPixel(result, x, y, gdTrueColor(value[0], value[1], value[2]));
 		}
 	}
+	return result;
+}
+
+double meanSquaredError(const gdImagePtr a, const gdImagePtr b, Channel channel) {
+	if (gdImageSX(a) != gdImageSX(b) || gdImageSY(a) != gdImageSY(b)) {
+		throw logic_error("dimensions don't match!!!");
+	}
+	double total = 0;
+	for (int y = 0; y < gdImageSY(a); y++) {
+		for (int x = 0; x < gdImageSX(a); x++) {
+			const double diff = (double)getPixel(a, x, y, channel, false) - getPixel(b, x, y, channel, false);
+			total += diff * diff;
+		}
+	}
+	return total / ((double)gdImageSX(a) * gdImageSY(a));
 }
 
 gdImagePtr blankCanvas(int width, int height, unsigned long seed) {
@@ -194,54 +242,35 @@ gdImagePtr blankCanvas(int width, int height, unsigned long seed) {
 	return result;
 }
 
-void interpolateErrors(gdImagePtr image, Channel channel) {
-	if (outputDebug()) {
-		output << "Interpolating to correct error pixels..." << endl;
-	}
-	bool success = true;
-	for (int x = 0; x < gdImageSX(image); x++) {
-		for (int y = 0; y < gdImageSY(image); y++) {
-			if (gdImageAlpha(image, gdImageGetPixel(image, x, y)) == gdAlphaOpaque) {
-				success = (success && interpolatePixel(image, x, y, channel));
-			}
-		}
-	}
-	if (!success) {
-		if (outputDebug()) {
-			output << "Interpolation incomplete, interpolating again." << endl;
+// Full range ITU-R BT.601, as used by JPEG
+void convertToYCbCr(gdImagePtr img) {
+	for (int y = 0; y < gdImageSY(img); y++) {
+		for (int x = 0; x < gdImageSX(img); x++) {
+			const int c = gdImageTrueColorPixel(img, x, y);
+			const double r = gdImageRed(img, c);
+			const double g = gdImageGreen(img, c);
+			const double b = gdImageBlue(img, c);
+			const int luma = boundColor(round(0.299*r + 0.587*g + 0.114*b));
+			const int cb = boundColor(round(128 - 0.168736*r - 0.331264*g + 0.5*b));
+			const int cr = boundColor(round(128 + 0.5*r - 0.418688*g - 0.081312*b));
+			gdImageTrueColorPixel(img, x, y) = gdTrueColorAlpha(luma, cb, cr, gdImageAlpha(img, c));
 		}
-		interpolateErrors(image, channel);
 	}
 }
 
-bool interpolatePixel(gdImagePtr image, int x, int y, Channel channel) {
-	const int pix[8] = {
-		wrappedGetPixel(image, x-1, y-1),
-		wrappedGetPixel(image, x,   y-1),
-		wrappedGetPixel(image, x+1, y-1),
-		wrappedGetPixel(image, x-1, y  ),
-		wrappedGetPixel(image, x+1, y  ),
-		wrappedGetPixel(image, x-1, y+1),
-		wrappedGetPixel(image, x,   y+1),
-		wrappedGetPixel(image, x+1, y+1)
-	};
-
-	size_t total = 0;
-	size_t numColored = 0;
-
-	for (size_t i = 0; i < 8; i++) {
-		if (gdImageAlpha(image, pix[i]) != gdAlphaOpaque) {
-			numColored++;
-			total += getColor(image, pix[i], channel);
+void convertFromYCbCr(gdImagePtr img) {
+	for (int y = 0; y < gdImageSY(img); y++) {
+		for (int x = 0; x < gdImageSX(img); x++) {
+			const int c = gdImageTrueColorPixel(img, x, y);
+			const double luma = gdImageRed(img, c);
+			const double cb = gdImageGreen(img, c) - 128.;
+			const double cr = gdImageBlue(img, c) - 128.;
+			const int r = boundColor(round(luma + 1.402*cr));
+			const int g = boundColor(round(luma - 0.344136*cb - 0.714136*cr));
+			const int b = boundColor(round(luma + 1.772*cb));
+			gdImageTrueColorPixel(img, x, y) = gdTrueColorAlpha(r, g, b, gdImageAlpha(img, c));
 		}
 	}
-
-	if (numColored < PIXELS_FOR_INTERP) {
-		return false;
-	} else {
-		setPixel(image, x, y, total/numColored, channel);
-		return true;
-	}
 }
 
 gdImagePtr loadImage(const char* fName) {
@@ -287,5 +316,55 @@ string channelToString(Channel channel) {
 	case C_GREEN:
 		return "green";
 		break;
+	case C_RGB:
+		return "rgb";
+		break;
+	case C_Y:
+		return "luma";
+		break;
+	case C_CB:
+		return "blue chroma";
+		break;
+	case C_CR:
+		return "red chroma";
+		break;
+	}
+}
+
+// C_RGB is the only channel made up of several others
+unsigned char getNumComponents(Channel channel) {
+	return (channel == C_RGB)?3:1;
+}
+
+// YCbCr images are kept in the red, green and blue slots of a gd image
+Channel getStorageChannel(Channel channel) {
+	switch(channel) {
+	default:
+		return channel;
+	case C_Y:
+		return C_RED;
+	case C_CB:
+		return C_GREEN;
+	case C_CR:
+		return C_BLUE;
+	}
+}
+
+bool isChroma(Channel channel) {
+	return channel == C_CB || channel == C_CR;
+}
+
+Channel getComponent(Channel channel, unsigned char i) {
+	if (channel != C_RGB) {
+		return channel;
+	}
+	switch(i) {
+	default:
+	case 0:
+		return C_RED;
+	case 1:
+		return C_GREEN;
+	case 2:
+		return C_BLUE;
 	}
 }
@@ -27,10 +27,18 @@ enum Channel {
 	C_GREY,
 	C_RED,
 	C_GREEN,
-	C_BLUE
+	C_BLUE,
+	C_RGB,
+	C_Y,
+	C_CB,
+	C_CR
 };
 
 std::string channelToString(Channel channel);
+unsigned char getNumComponents(Channel channel);
+Channel getComponent(Channel channel, unsigned char i);
+Channel getStorageChannel(Channel channel);
+bool isChroma(Channel channel);
 
 gdImagePtr edgeDetectSobel(const gdImagePtr image, Channel channel);
 gdImagePtr edgeDetectLaplace(const gdImagePtr image, Channel channel);
@@ -40,15 +48,17 @@ unsigned char getColor(const gdImagePtr img, int c, Channel channel);
 unsigned char getGrey(const gdImagePtr img, int c);
 unsigned char getPixel(const gdImagePtr img, int x, int y, Channel channel, bool check=true);
 void setPixel(gdImagePtr img, int x, int y, unsigned char value, Channel channel, unsigned char alpha=gdAlphaOpaque);
+void setErrorPixel(gdImagePtr img, int x, int y, Channel channel);
 gdImagePtr blankCanvas(int w, int h, unsigned long seed);
-void interpolateErrors(gdImagePtr img, Channel channel);
-bool interpolatePixel(gdImagePtr img, int x, int y, Channel channel);
+gdImagePtr scaleBilinear(const gdImagePtr img, int width, int height);
+void convertToYCbCr(gdImagePtr img);
+void convertFromYCbCr(gdImagePtr img);
 
 inline unsigned char boundColor(int c) {
 	return (c>gdRedMax)?(gdRedMax):((c<0)?0:c);
 }
 
-void clearAlpha(gdImagePtr img);
+double meanSquaredError(const gdImagePtr a, const gdImagePtr b, Channel channel);
 
 gdImagePtr loadImage(const char* fName);
 
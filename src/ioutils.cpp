@@ -20,6 +20,9 @@
 #include "ioutils.h"
 
 #include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
 
 using namespace std;
 
@@ -122,3 +125,39 @@ string getBasename(string filename) {
 		return filename.substr(loc+1);
 	}
 }
+
+// Replaces the %d conversions of pattern (which may be zero padded to a
+// width, as in %04d) with values in turn. Anything else, including any %d
+// after the last value, is copied as it is, so user supplied patterns never
+// reach printf. Returns false if pattern has no %d at all.
+bool fillNumbers(const string& pattern, const vector<int>& values, string& result) {
+	result.clear();
+	vector<int>::size_type next = 0;
+	bool found = false;
+	size_t i = 0;
+	while (i < pattern.size()) {
+		size_t end = i + 1;
+		if (pattern[i] == '%') {
+			while (end < pattern.size() && isdigit((unsigned char)pattern[end])) {
+				end++;
+			}
+		}
+		if (pattern[i] != '%' || end >= pattern.size() || pattern[end] != 'd') {
+			result += pattern[i];
+			i++;
+			continue;
+		}
+		found = true;
+		if (next == values.size()) {
+			result.append(pattern, i, end + 1 - i);
+		} else {
+			// The flag and width are only digits, so the format is bounded
+			const string format = "%" + pattern.substr(i + 1, min(end - i - 1, (size_t)4)) + "d";
+			char number[32];
+			snprintf(number, sizeof(number), format.c_str(), values[next++]);
+			result += number;
+		}
+		i = end + 1;
+	}
+	return found;
+}
@@ -23,6 +23,7 @@
 #include <ostream>
 #include <istream>
 #include <string>
+#include <vector>
 
 void serializeDouble(std::ostream& out, double d);
 void serializeFraction(std::ostream& out, double d, int min, int max);
@@ -37,5 +38,6 @@ signed int unserializeSignedInt(std::istream& in);
 std::string unserializeString(std::istream& in);
 
 std::string getBasename(std::string filename);
+bool fillNumbers(const std::string& pattern, const std::vector<int>& values, std::string& result);
 
 #endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that --lod-depth previews stay close to the full decode, and cost
+// less: encodes a made up image, decodes it whole and cut at a few depths,
+// and compares them.
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include "gd.h"
+
+#include "constant.h"
+#include "doubleimage.h"
+#include "fractalimage.h"
+#include "imageutils.h"
+#include "output.h"
+
+using namespace std;
+
+signed char outputLevel = OUTPUT_ERROR;
+
+std::ostream& output = std::cerr;
+
+static const int SIZE = 96;
+
+// Smallest PSNR (dB) against the full decode for each --lod-depth. Every cut
+// also has to beat a flat image of the mean.
+static const int NUM_DEPTHS = 4;
+static const int DEPTHS[NUM_DEPTHS] = {1, 2, 3, 4};
+static const double MIN_PSNR[NUM_DEPTHS] = {16, 19, 21, 24};
+
+// Largest share of the work of the full decode a preview may take
+static const double MAX_COST = 0.5;
+
+// Shading, texture and a few edges, something like a photograph
+static gdImagePtr makeImage() {
+	gdImagePtr img = gdImageCreateTrueColor(SIZE, SIZE);
+	for (int y = 0; y < SIZE; y++) {
+		for (int x = 0; x < SIZE; x++) {
+			const double u = (double)x / SIZE;
+			const double v = (double)y / SIZE;
+			double value = 60 + 90 * u + 40 * sin(6 * v + 2 * u) + 25 * sin(40 * u) * sin(33 * v);
+			const double dx = u - 0.6;
+			const double dy = v - 0.4;
+			if (dx * dx + dy * dy < 0.05) {
+				value += 70 * (1 - v);
+			}
+			if (((x / 12) + (y / 12)) % 2 == 0 && v > 0.6) {
+				value -= 50;
+			}
+			const int grey = min(max((int)value, 0), gdRedMax);
+			gdImageSetPixel(img, x, y, gdTrueColor(grey, grey, grey));
+		}
+	}
+	return img;
+}
+
+static double getPSNR(const gdImagePtr a, const gdImagePtr b) {
+	const double mse = meanSquaredError(a, b, C_GREY);
+	if (mse <= 0) {
+		return HUGE_VAL;
+	}
+	return 10 * log10((gdRedMax * gdRedMax) / mse);
+}
+
+// Decodes the fractal cut at maxDepth, or whole if it is negative, the way
+// fractal does by default: the whole fractal for DEFAULT_ITERATIONS, and a
+// preview until an iteration changes it by less than PYRAMID_TOLERANCE.
+// cost is set to the work done, in iterations at the full size.
+static gdImagePtr decodeAt(const string& serial, int maxDepth, double& cost) {
+	gdImagePtr seedImage = blankCanvas(SIZE, SIZE, serial.size());
+	DoubleImage img(seedImage);
+	gdFree(seedImage);
+
+	istringstream in(serial, ios_base::in | ios_base::binary);
+	FractalImage fractal(in, img);
+	cost = 0;
+	if (maxDepth >= 0) {
+		const size_t fitPixels = fractal.setDetailLimit(maxDepth, 0);
+		cost += LOD_FIT_ITERATIONS * (double)fitPixels / (SIZE * SIZE);
+	}
+	for (int i = 0; i < DEFAULT_ITERATIONS; i++) {
+		fractal.iterate(true);
+		cost++;
+		if (maxDepth >= 0 && sqrt(meanSquaredError(fractal.getPreviousImage(), fractal.getImage().getImage(), C_GREY)) < PYRAMID_TOLERANCE) {
+			break;
+		}
+	}
+	return fractal.exportImage();
+}
+
+int main() {
+	gdImagePtr original = makeImage();
+	stringstream serial(ios_base::out | ios_base::in | ios_base::binary);
+	{
+		FractalImage fractal(DoubleImage(original), FractalImage::T_GREYSCALE);
+		fractal.encode(DEFAULT_ERROR_CUTOFF / 2);
+		fractal.serialize(serial);
+	}
+
+	double fullCost;
+	gdImagePtr full = decodeAt(serial.str(), -1, fullCost);
+	const double fullPSNR = getPSNR(original, full);
+	cout << "Full decode: " << fullPSNR << " dB, " << fullCost << " iterations" << endl;
+
+	// Against a flat image of the mean the error is the variance
+	double total = 0;
+	double squares = 0;
+	for (int y = 0; y < SIZE; y++) {
+		for (int x = 0; x < SIZE; x++) {
+			const double value = gdImageRed(full, gdImageTrueColorPixel(full, x, y));
+			total += value;
+			squares += value * value;
+		}
+	}
+	const double average = total / (SIZE * SIZE);
+	const double meanPSNR = 10 * log10((gdRedMax * gdRedMax) / (squares / (SIZE * SIZE) - average * average));
+	cout << "Mean: " << meanPSNR << " dB" << endl;
+
+	int failures = 0;
+	for (int i = 0; i < NUM_DEPTHS; i++) {
+		double cost;
+		gdImagePtr preview = decodeAt(serial.str(), DEPTHS[i], cost);
+		const double psnr = getPSNR(full, preview);
+		gdFree(preview);
+		const bool ok = psnr >= MIN_PSNR[i] && psnr > meanPSNR && cost <= MAX_COST * fullCost;
+		cout << "Depth " << DEPTHS[i] << ": " << psnr << " dB against the full decode, " << cost << " iterations" << (ok?"":" FAILED") << endl;
+		if (!ok) {
+			failures++;
+		}
+	}
+
+	gdFree(full);
+	gdFree(original);
+	return (failures == 0)?0:1;
+}
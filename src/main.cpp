@@ -19,9 +19,17 @@
  */
 #include <cstdio>
 #include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <limits>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "gd.h"
 #include "getopt.h"
 
@@ -31,6 +39,12 @@
 #include "output.h"
 #include "fractalimage.h"
 #include "ioutils.h"
+#include "fitcache.h"
+#include "fractalsequence.h"
+#include "framesource.h"
+#include "tiledfractal.h"
+#include "threadutils.h"
+#include "tilepyramid.h"
 
 using namespace std;
 
@@ -49,6 +63,41 @@ static DoubleImage::DivisionType dType = DEFAULT_DIVISION_TYPE;
 static DoubleImage::Metric metric = DEFAULT_METRIC;
 static TriangleTree::SubdivisionMethod sMethod = DEFAULT_SUBDIVISION_METHOD;
 static DoubleImage::EdgeDetectionMethod edMethod = DEFAULT_EDGE_DETECTION_METHOD;
+static TriangleTree::SubdivisionOrder sOrder = DEFAULT_SUBDIVISION_ORDER;
+static bool orderSet = false;
+static size_t maxTriangles = 0;
+static size_t maxBytes = 0;
+static double targetPSNR = 0;
+static size_t targetBytes = 0;
+static double chromaScale = DEFAULT_CHROMA_SCALE;
+static bool checkpoint = false;
+static const char* checkpointFilename = NULL;
+static double checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+static bool resume = false;
+static int tileSize = 0;
+static int tileOverlap = DEFAULT_TILE_OVERLAP;
+static unsigned int numThreads = DEFAULT_THREADS;
+static FractalImage::Decoder decoder = DEFAULT_DECODER;
+static DecodePlan::Order decodeOrder = DEFAULT_DECODE_ORDER;
+static double tolerance = DEFAULT_TOLERANCE;
+static int pyramidLevels = DEFAULT_PYRAMID_LEVELS;
+static int thumbnailSize = DEFAULT_THUMBNAIL_SIZE;
+// Zero width decodes the whole image
+static int regionX = 0;
+static int regionY = 0;
+static int regionWidth = 0;
+static int regionHeight = 0;
+static int zoomLevels = 0;
+// A negative level writes the whole pyramid instead of one tile
+static int zoomTileLevel = -1;
+static int zoomTileX = 0;
+static int zoomTileY = 0;
+// A negative depth and zero area decode every triangle
+static int lodDepth = -1;
+static double lodArea = 0;
+static bool batch = false;
+// Extra output sizes, where a height of zero keeps the -w by -h ratio
+static vector<pair<int, int> > sizes;
 
 static const char* name = "Fractal Image Compressor";
 
@@ -73,16 +122,64 @@ static const struct option longOptions[] = {
 	{"seed", required_argument, 0, 's'},
 	{"color", no_argument, 0, 'C'},
 	{"greyscale", no_argument, 0, 'G'},
+	{"shared-color", no_argument, 0, 'r'},
+	{"ycbcr", no_argument, 0, 'y'},
+	{"chroma-scale", required_argument, 0, 'x'},
 	{"split", required_argument, 0, '2'},
 	{"metric", required_argument, 0, '3'},
 	{"subdivide", required_argument, 0, '6'},
-	{"edges", required_argument, 0, '7'}
+	{"edges", required_argument, 0, '7'},
+	{"order", required_argument, 0, '8'},
+	{"max-triangles", required_argument, 0, '9'},
+	{"max-bytes", required_argument, 0, 'b'},
+	{"target-psnr", required_argument, 0, 'p'},
+	{"target-bytes", required_argument, 0, 't'},
+	{"checkpoint", optional_argument, 0, 'k'},
+	{"checkpoint-interval", required_argument, 0, 'K'},
+	{"resume", no_argument, 0, 'R'},
+	{"tile", required_argument, 0, 'T'},
+	{"tile-overlap", required_argument, 0, 'O'},
+	{"threads", required_argument, 0, 'j'},
+	{"decoder", required_argument, 0, 'D'},
+	{"decode-order", required_argument, 0, 'Q'},
+	{"pyramid", required_argument, 0, 'P'},
+	{"thumbnail", required_argument, 0, 'U'},
+	{"region", required_argument, 0, 'g'},
+	{"zoom", required_argument, 0, 'z'},
+	{"zoom-tile", required_argument, 0, 'Z'},
+	{"lod-depth", required_argument, 0, 'E'},
+	{"lod-area", required_argument, 0, 'A'},
+	{"batch", no_argument, 0, 'B'},
+	{"sizes", required_argument, 0, 'S'},
+	{"tolerance", required_argument, 0, 'L'}
 };
 
-static const char* shortOptions = "vqedo:Hw:h:i:c:IVs:CG";
+static const char* shortOptions = "vqedo:Hw:h:i:c:IVs:CGj:";
 
 static int encodeImage(const char* in, const char* out);
+static int encodeSequence(const char* in, const char* out);
+static int encodeTiled(const char* in, const char* out);
+static void setupEncoder(FractalImage& fractal, const char* in, FitCache* cache);
+static double measurePSNR(const FractalImage& fractal, const gdImagePtr original);
+static double imageMSE(const gdImagePtr a, const gdImagePtr b, FractalImage::ImageType type);
+static int decodeIterations(FractalImage& fractal, double& delta, int limit, double stop);
+static int decodePyramid(FractalImage& fractal, double& delta);
+static double getUpscaledTolerance();
+static double getStartTolerance();
+static double searchCutoff(const DoubleImage& img, const gdImagePtr original, const char* in, FitCache* cache);
+static bool setupDecoder(FractalImage& fractal, bool thumbnailSeed);
 static int decodeImage(const char* in, const char* out, const char* seed);
+static int decodeBatch(const std::vector<std::string>& files, const char* out, const char* seed);
+static std::string getBatchFilename(const std::string& in, const char* out);
+static int decodeSequence(std::istream& inStream, const char* out, gdImagePtr seedImage, bool thumbnailSeed);
+static std::string getFrameFilename(const char* out, std::size_t frame);
+static int decodeTiled(std::istream& inStream, const char* out, gdImagePtr seedImage, bool thumbnailSeed);
+static int writeZoom(FractalImage& fractal, const char* out);
+static int writeSizes(FractalImage& fractal, const char* out);
+static std::string getSizeFilename(const char* out, int width, int height);
+static bool savePng(gdImagePtr image, const std::string& filename);
+static bool parseCount(const char* arg, std::size_t& value);
+static int infoTiled(std::istream& inStream);
 static int printHelp();
 static int printVersion();
 static int infoImage(const char* in);
@@ -139,6 +236,64 @@ int main(int argc, char* argv[]) {
 		case 'i':
 			iterations = atoi(optarg);
 			break;
+		case 'P':
+			pyramidLevels = atoi(optarg);
+			break;
+		case 'U':
+			thumbnailSize = atoi(optarg);
+			if (thumbnailSize < 0 || thumbnailSize > MetaData::MAX_THUMBNAIL_SIZE) {
+				thumbnailSize = DEFAULT_THUMBNAIL_SIZE;
+				if (outputError()) {
+					output << "The thumbnail size must be between 0 and " << MetaData::MAX_THUMBNAIL_SIZE << "." << endl;
+				}
+			}
+			break;
+		case 'z':
+			zoomLevels = max(atoi(optarg), 0);
+			break;
+		case 'Z':
+			if (sscanf(optarg, "%d/%d/%d", &zoomTileLevel, &zoomTileX, &zoomTileY) != 3 || zoomTileLevel < 0) {
+				zoomTileLevel = -1;
+				if (outputError()) {
+					output << "Invalid zoom tile." << endl;
+				}
+			}
+			break;
+		case 'B':
+			batch = true;
+			break;
+		case 'S': {
+			sizes.clear();
+			stringstream list(optarg);
+			string size;
+			while (getline(list, size, ',')) {
+				int w = 0;
+				int h = 0;
+				if (sscanf(size.c_str(), "%dx%d", &w, &h) < 1 || w <= 0 || h < 0) {
+					if (outputError()) {
+						output << "Invalid size " << size << "." << endl;
+					}
+					continue;
+				}
+				sizes.push_back(make_pair(w, h));
+			}
+			break;
+		}
+		case 'E':
+			lodDepth = atoi(optarg);
+			break;
+		case 'A':
+			lodArea = max(atof(optarg), 0.0);
+			break;
+		case 'g':
+			if (sscanf(optarg, "%d,%d,%d,%d", &regionX, &regionY, &regionWidth, &regionHeight) != 4 ||
+			    regionWidth <= 0 || regionHeight <= 0) {
+				regionWidth = 0;
+				if (outputError()) {
+					output << "Invalid region." << endl;
+				}
+			}
+			break;
 		case 'c':
 			errorCutoff = atof(optarg);
 			break;
@@ -211,6 +366,96 @@ int main(int argc, char* argv[]) {
 			}
 			break;
 		}
+		case '8': {
+			string arg(optarg);
+			if (arg == "breadth") {
+				sOrder = TriangleTree::O_BREADTHFIRST;
+			} else if (arg == "best") {
+				sOrder = TriangleTree::O_BESTFIRST;
+			} else {
+				if (outputError()) {
+					output << "Invalid subdivision order." << endl;
+				}
+				return 1;
+			}
+			orderSet = true;
+			break;
+		}
+		case '9':
+			if (!parseCount(optarg, maxTriangles)) {
+				if (outputError()) {
+					output << "Invalid triangle budget." << endl;
+				}
+				return 1;
+			}
+			break;
+		case 'b':
+			if (!parseCount(optarg, maxBytes)) {
+				if (outputError()) {
+					output << "Invalid byte budget." << endl;
+				}
+				return 1;
+			}
+			break;
+		case 'p':
+			targetPSNR = atof(optarg);
+			break;
+		case 't':
+			targetBytes = strtoul(optarg, NULL, 10);
+			break;
+		case 'k':
+			checkpoint = true;
+			checkpointFilename = optarg;
+			break;
+		case 'K':
+			checkpointInterval = atof(optarg);
+			break;
+		case 'R':
+			checkpoint = true;
+			resume = true;
+			break;
+		case 'T':
+			tileSize = atoi(optarg);
+			break;
+		case 'O':
+			tileOverlap = atoi(optarg);
+			break;
+		case 'j':
+			numThreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'L':
+			tolerance = atof(optarg);
+			break;
+		case 'D': {
+			string arg(optarg);
+			if (arg == "direct") {
+				decoder = FractalImage::D_DIRECT;
+			} else if (arg == "compiled") {
+				decoder = FractalImage::D_COMPILED;
+			} else if (arg == "pingpong") {
+				decoder = FractalImage::D_PINGPONG;
+			} else if (arg == "inplace") {
+				decoder = FractalImage::D_INPLACE;
+			} else {
+				if (outputError()) {
+					output << "Invalid decoder." << endl;
+				}
+			}
+			break;
+		}
+		case 'Q': {
+			string arg(optarg);
+			if (arg == "tree") {
+				decodeOrder = DecodePlan::O_TREE;
+			} else if (arg == "dependency") {
+				decodeOrder = DecodePlan::O_DEPENDENCY;
+			} else {
+				if (outputError()) {
+					output << "Invalid decode order." << endl;
+				}
+			}
+			break;
+		}
 		case '4':
 			fixErrors = true;
 			break;
@@ -226,6 +471,15 @@ int main(int argc, char* argv[]) {
 		case 'G':
 			colorMode = FractalImage::T_GREYSCALE;
 			break;
+		case 'r':
+			colorMode = FractalImage::T_SHAREDCOLOR;
+			break;
+		case 'y':
+			colorMode = FractalImage::T_YCBCR;
+			break;
+		case 'x':
+			chromaScale = atof(optarg);
+			break;
 		default:
 		case '?':
 			return 1;
@@ -233,6 +487,43 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	// A budget only makes sense when the worst triangles are refined first
+	if ((maxTriangles != 0 || maxBytes != 0) && !orderSet) {
+		sOrder = TriangleTree::O_BESTFIRST;
+	}
+
+	if (targetPSNR > 0 && targetBytes != 0) {
+		if (outputError()) {
+			output << "Only one of --target-psnr and --target-bytes may be given." << endl;
+		}
+		return 1;
+	}
+
+	// The rate control passes share a fit cache which a resumed encode
+	// would not have, so the result could not be reproduced
+	if (checkpoint && (targetPSNR > 0 || targetBytes != 0)) {
+		if (outputError()) {
+			output << "--checkpoint and --resume can not be used with a target." << endl;
+		}
+		return 1;
+	}
+
+	// Only the part of --region inside the output size is decoded
+	if (mode == M_DECODE && regionWidth != 0) {
+		const long long right = min((long long)regionX + regionWidth, (long long)width);
+		const long long bottom = min((long long)regionY + regionHeight, (long long)height);
+		regionX = max(regionX, 0);
+		regionY = max(regionY, 0);
+		if (right <= regionX || bottom <= regionY) {
+			if (outputError()) {
+				output << "The region is outside the image." << endl;
+			}
+			return 1;
+		}
+		regionWidth = right - regionX;
+		regionHeight = bottom - regionY;
+	}
+
 	int result = 0;
 
 	switch (mode) {
@@ -252,12 +543,30 @@ int main(int argc, char* argv[]) {
 			result = 1;
 		} else {
 			for (; optind < argc; optind++) {
-				result = encodeImage(argv[optind], outputFilename);
+				if (FrameSource::isSequence(argv[optind])) {
+					result = encodeSequence(argv[optind], outputFilename);
+				} else if (tileSize > 0) {
+					result = encodeTiled(argv[optind], outputFilename);
+				} else {
+					result = encodeImage(argv[optind], outputFilename);
+				}
 			}
 		}
 		break;
 	case M_DECODE:
-		if (optind == argc) {
+		if (batch) {
+			// Without any files the names are read from stdin, one per line
+			vector<string> files(argv + optind, argv + argc);
+			if (files.empty()) {
+				string line;
+				while (getline(cin, line)) {
+					if (!line.empty()) {
+						files.push_back(line);
+					}
+				}
+			}
+			result = decodeBatch(files, outputFilename, seed);
+		} else if (optind == argc) {
 			if (outputError()) {
 				output << "Decoding requires a source fractal." << endl;
 			}
@@ -303,18 +612,230 @@ int encodeImage(const char* in, const char* out) {
 	}
 
 	DoubleImage img(lenna, sType, dType, metric, edMethod);
-	FractalImage fractal(img, colorMode);
-	gdFree(lenna);
 
-	fractal.setSubdivisionMethod(sMethod);
+	double cutoff = errorCutoff;
+	FitCache cache;
+	FractalImage* fractal = NULL;
 
-	fractal.getMetadata().setSourceFilename(getBasename(in));
+	string checkpointName;
+	if (checkpoint) {
+		checkpointName = (checkpointFilename != NULL)?string(checkpointFilename):(string(out) + DEFAULT_CHECKPOINT_SUFFIX);
+	}
+
+	if (resume) {
+		ifstream state(checkpointName.c_str(), ios_base::in | ios_base::binary);
+		if (state.good()) {
+			try {
+				fractal = FractalImage::loadState(state, img, cutoff);
+			} catch (const logic_error& e) {
+				openError(checkpointName, e.what());
+				gdFree(lenna);
+				return 1;
+			}
+			if (outputStd()) {
+				output << "Resuming from " << checkpointName << "." << endl;
+			}
+		} else if (outputStd()) {
+			output << "No checkpoint found at " << checkpointName << ", starting from scratch." << endl;
+		}
+	}
+
+	if (fractal == NULL) {
+		if (targetPSNR > 0 || targetBytes != 0) {
+			cutoff = searchCutoff(img, lenna, in, &cache);
+		}
+		fractal = new FractalImage(img, colorMode);
+		setupEncoder(*fractal, in, &cache);
+	}
+	gdFree(lenna);
+
+	if (checkpoint) {
+		fractal->setCheckpoint(checkpointName, checkpointInterval);
+	}
 
 	if (outputStd()) {
 		output << in << " loaded, encoding..." << endl;
 	}
 
-	fractal.encode(errorCutoff);
+	fractal->encode(cutoff);
+
+	ofstream outStream(out, ios_base::out | ios_base::trunc | ios_base::binary);
+
+	if (!outStream.good()) {
+		openError(out);
+		delete fractal;
+		return 1;
+	}
+
+	if (outputStd()) {
+		output << "Saving fractal (" << fractal->getSize() << " triangles) to " << out << "." << endl;
+	}
+
+	fractal->serialize(outStream);
+	outStream.close();
+	delete fractal;
+
+	// The finished fractal supersedes the checkpoint
+	if (checkpoint) {
+		remove(checkpointName.c_str());
+	}
+
+	if (outputStd()) {
+		output << "Done." << endl;
+	}
+	return 0;
+}
+
+// Every frame after the first starts from the tree of the one before it, so
+// for mostly static sequences only the parts that changed are searched.
+int encodeSequence(const char* in, const char* out) {
+	if (out == NULL) {
+		out = DEFAULT_ENC_FNAME;
+	}
+
+	if (checkpoint || targetPSNR > 0 || targetBytes != 0) {
+		if (outputError()) {
+			output << "Sequences can not be encoded with a target or checkpoints." << endl;
+		}
+		return 1;
+	}
+
+	ofstream outStream(out, ios_base::out | ios_base::trunc | ios_base::binary);
+
+	if (!outStream.good()) {
+		openError(out);
+		return 1;
+	}
+
+	SequenceWriter writer(outStream);
+	FractalImage* previous = NULL;
+	FractalImage* fractal = NULL;
+
+	try {
+		FrameSource source(in);
+		gdImagePtr frame;
+		while ((frame = source.next()) != NULL) {
+			// The fit cache is keyed on geometry, which every frame shares,
+			// so it can not be used across frames
+			DoubleImage img(frame, sType, dType, metric, edMethod);
+			fractal = new FractalImage(img, colorMode);
+			gdFree(frame);
+			setupEncoder(*fractal, in, NULL);
+
+			if (outputStd()) {
+				output << "Encoding frame #" << writer.getNumFrames() << "..." << endl;
+			}
+			bool keyFrame = true;
+			if (previous != NULL) {
+				keyFrame = !fractal->inherit(*previous, errorCutoff);
+				if (keyFrame) {
+					// Start over from the frame's own image
+					FractalImage* fresh = new FractalImage(img, colorMode);
+					delete fractal;
+					fractal = fresh;
+					setupEncoder(*fractal, in, NULL);
+					if (outputStd()) {
+						output << "Too much has changed, encoding a key frame." << endl;
+					}
+				}
+			}
+			fractal->encode(errorCutoff);
+
+			const size_t bytes = writer.write(*fractal, keyFrame);
+			if (outputStd()) {
+				output << "Frame #" << (writer.getNumFrames() - 1) << ": " << fractal->getSize() << " triangles, ";
+				output << bytes << " bytes." << endl;
+			}
+
+			delete previous;
+			previous = fractal;
+			fractal = NULL;
+		}
+	} catch (const runtime_error& e) {
+		openError(in, e.what());
+		delete previous;
+		delete fractal;
+		return 1;
+	} catch (const logic_error& e) {
+		openError(in, e.what());
+		delete previous;
+		delete fractal;
+		return 1;
+	}
+	delete previous;
+	outStream.close();
+
+	if (outputStd()) {
+		output << "Saved " << writer.getNumFrames() << " frames to " << out << "." << endl;
+	}
+	return 0;
+}
+
+// Each tile gets its own copy of its part of the image and its own tree, so
+// the caches that grow with the number of triangles are bounded by the tile
+// size. Only the source raster itself is held in full.
+int encodeTiled(const char* in, const char* out) {
+	if (out == NULL) {
+		out = DEFAULT_ENC_FNAME;
+	}
+
+	if (checkpoint || targetPSNR > 0 || targetBytes != 0) {
+		if (outputError()) {
+			output << "Tiled images can not be encoded with a target or checkpoints." << endl;
+		}
+		return 1;
+	}
+
+	gdImagePtr source;
+
+	try {
+		source = loadImage(in);
+	} catch (const runtime_error& e) {
+		openError(in, e.what());
+		return 1;
+	}
+
+	TiledFractal tiled(gdImageSX(source), gdImageSY(source), tileSize, tileOverlap);
+	tiled.getMetadata().setSourceFilename(getBasename(in));
+	vector<TiledFractal::Tile>& tiles = tiled.getTiles();
+
+	if (outputStd()) {
+		output << in << " loaded, encoding " << tiles.size() << " tiles on ";
+		output << min((size_t)getNumThreads(numThreads), tiles.size()) << " threads..." << endl;
+	}
+
+	vector<char> failed(tiles.size(), 0);
+	parallelFor(tiles.size(), numThreads, [&](size_t i) {
+		TiledFractal::Tile& tile = tiles[i];
+		gdImagePtr crop = gdImageCreateTrueColor(tile.width, tile.height);
+		gdImageCopy(crop, source, 0, 0, tile.x, tile.y, tile.width, tile.height);
+		DoubleImage img(crop, sType, dType, metric, edMethod);
+		gdFree(crop);
+
+		try {
+			FractalImage fractal(img, colorMode);
+			setupEncoder(fractal, in, NULL);
+			fractal.encode(errorCutoff);
+
+			ostringstream serial(ios_base::out|ios_base::binary);
+			fractal.serialize(serial);
+			tile.fractal = serial.str();
+
+			if (outputVerbose()) {
+				output << "Tile #" << i << " done (" << fractal.getSize() << " triangles)." << endl;
+			}
+		} catch (const exception& e) {
+			if (outputError()) {
+				output << "Could not encode tile #" << i << " (" << e.what() << ")." << endl;
+			}
+			failed[i] = 1;
+		}
+	});
+	gdFree(source);
+
+	if (find(failed.begin(), failed.end(), 1) != failed.end()) {
+		return 1;
+	}
 
 	ofstream outStream(out, ios_base::out | ios_base::trunc | ios_base::binary);
 
@@ -324,10 +845,10 @@ int encodeImage(const char* in, const char* out) {
 	}
 
 	if (outputStd()) {
-		output << "Saving fractal (" << fractal.getSize() << " triangles) to " << out << "." << endl;
+		output << "Saving tiled fractal to " << out << "." << endl;
 	}
 
-	fractal.serialize(outStream);
+	tiled.serialize(outStream);
 	outStream.close();
 
 	if (outputStd()) {
@@ -336,9 +857,202 @@ int encodeImage(const char* in, const char* out) {
 	return 0;
 }
 
+void setupEncoder(FractalImage& fractal, const char* in, FitCache* cache) {
+	fractal.setSubdivisionMethod(sMethod);
+	fractal.setSubdivisionOrder(sOrder);
+	fractal.setMaxTriangles(maxTriangles);
+	fractal.setMaxBytes(maxBytes);
+	fractal.setFitCache(cache);
+	fractal.setChromaScale(chromaScale);
+	if (thumbnailSize > 0) {
+		fractal.setThumbnail(thumbnailSize);
+	}
+
+	fractal.getMetadata().setSourceFilename(getBasename(in));
+}
+
+double measurePSNR(const FractalImage& fractal, const gdImagePtr original) {
+	stringstream serial(ios_base::out|ios_base::in|ios_base::binary);
+	fractal.serialize(serial);
+
+	gdImagePtr seedImage = blankCanvas(gdImageSX(original), gdImageSY(original), serial.str().size());
+	DoubleImage img(seedImage, sType, dType, metric, edMethod);
+	gdFree(seedImage);
+
+	FractalImage decoded(serial, img);
+	decoded.setDecoder(decoder);
+	decoded.setDecodeOrder(decodeOrder);
+	decoded.setThreads(numThreads);
+	decoded.seedFromThumbnail();
+
+	double delta;
+	decodeIterations(decoded, delta, iterations, tolerance);
+
+	gdImagePtr result = decoded.exportImage();
+	const double mse = imageMSE(original, result, fractal.getType());
+	gdFree(result);
+	if (mse <= 0) {
+		return HUGE_VAL;
+	}
+	return 10 * log10((gdRedMax * gdRedMax) / mse);
+}
+
+double imageMSE(const gdImagePtr a, const gdImagePtr b, FractalImage::ImageType type) {
+	if (type == FractalImage::T_GREYSCALE) {
+		return meanSquaredError(a, b, C_GREY);
+	}
+	return (meanSquaredError(a, b, C_RED) +
+	        meanSquaredError(a, b, C_GREEN) +
+	        meanSquaredError(a, b, C_BLUE)) / 3;
+}
+
+// Runs up to limit decoding passes. If stop is positive it stops as soon as
+// a pass changes the image by less than it (rms), and delta is the change
+// made by the last pass. Returns the number of passes run.
+int decodeIterations(FractalImage& fractal, double& delta, int limit, double stop) {
+	delta = HUGE_VAL;
+	for (int i = 1; i <= limit; i++) {
+		if (outputVerbose()) {
+			output << "evaulating iteration #" << i << endl;
+		}
+		fractal.iterate(fixErrors);
+		if (stop > 0) {
+			delta = sqrt(imageMSE(fractal.getPreviousImage(), fractal.getImage().getImage(), fractal.getType()));
+		}
+		if (outputVerbose()) {
+			output << "Iteration #" << i <<" done." << endl;
+		}
+		if (stop > 0 && delta < stop) {
+			return i;
+		}
+	}
+	return limit;
+}
+
+// With --pyramid the iterations run on an image halved levels-1 times, and
+// every level after that starts from the one before it scaled up. Those
+// only have to wash out the scaling, so they stop at --tolerance, or at
+// PYRAMID_TOLERANCE without one, and few passes run at the full size.
+// Levels that would be smaller than MIN_PYRAMID_SIZE are skipped. Returns
+// the number of passes run at the full size.
+int decodePyramid(FractalImage& fractal, double& delta) {
+	const int width = fractal.getImage().getWidth();
+	const int height = fractal.getImage().getHeight();
+	int levels = max(pyramidLevels, 1);
+	while (levels > 1 && min(width, height) >> (levels - 1) < MIN_PYRAMID_SIZE) {
+		levels--;
+	}
+	if (levels == 1) {
+		return decodeIterations(fractal, delta, iterations, getStartTolerance());
+	}
+
+	int used = 0;
+	for (int level = levels - 1; level >= 0; level--) {
+		const DoubleImage& current = fractal.getImage();
+		gdImagePtr scaled = gdImageCreateTrueColor(width >> level, height >> level);
+		gdImageCopyResampled(scaled, current.getImage(), 0, 0, 0, 0,
+		                     gdImageSX(scaled), gdImageSY(scaled),
+		                     current.getWidth(), current.getHeight());
+		fractal.setImage(DoubleImage(scaled, sType, dType, metric, edMethod));
+		gdFree(scaled);
+		if (outputVerbose()) {
+			output << "Decoding at " << (width >> level) << "x" << (height >> level) << "..." << endl;
+		}
+		used = decodeIterations(fractal, delta, iterations, (level == levels - 1)?getStartTolerance():getUpscaledTolerance());
+	}
+	return used;
+}
+
+// The tolerance for an image that starts from one that settled at a smaller
+// size, which only has to wash out the scaling
+double getUpscaledTolerance() {
+	return (tolerance > 0)?tolerance:PYRAMID_TOLERANCE;
+}
+
+// The tolerance for the first decode of a fractal. A --lod-depth or
+// --lod-area preview starts from a small decode of the whole trees scaled
+// up, so it only needs as many iterations as an upscaled image does.
+double getStartTolerance() {
+	return (lodDepth >= 0 || lodArea > 0)?getUpscaledTolerance():tolerance;
+}
+
+// Bisects (geometrically) on the cutoff for the loosest cutoff that still
+// meets --target-psnr, or the tightest one that still meets --target-bytes.
+// Every pass shares the fit cache so only the first one does most of the
+// domain searching.
+double searchCutoff(const DoubleImage& img, const gdImagePtr original, const char* in, FitCache* cache) {
+	double low = MIN_TARGET_CUTOFF;
+	double high = MAX_TARGET_CUTOFF;
+	double best = -1;
+
+	if (outputStd()) {
+		output << in << " loaded, searching for cutoff..." << endl;
+	}
+
+	for (int pass = 1; pass <= RATE_CONTROL_PASSES; pass++) {
+		const double cutoff = sqrt(low * high);
+
+		FractalImage fractal(img, colorMode);
+		setupEncoder(fractal, in, cache);
+		fractal.encode(cutoff);
+
+		const size_t size = fractal.getSerializedSize();
+		bool ok;
+		if (targetBytes != 0) {
+			ok = (size <= targetBytes);
+			if (outputStd()) {
+				output << "Pass #" << pass << ": cutoff " << cutoff << " gives " << size << " bytes." << endl;
+			}
+		} else {
+			const double psnr = measurePSNR(fractal, original);
+			ok = (psnr >= targetPSNR);
+			if (outputStd()) {
+				output << "Pass #" << pass << ": cutoff " << cutoff << " gives " << psnr << " dB." << endl;
+			}
+		}
+		if (outputVerbose()) {
+			output << "Fit cache: " << cache->getSize() << " fits, " << cache->getHits() << " hits, ";
+			output << cache->getMisses() << " misses." << endl;
+		}
+
+		// A looser cutoff means a smaller file of lower quality
+		if (ok) {
+			best = cutoff;
+		}
+		if (ok == (targetBytes == 0)) {
+			low = cutoff;
+		} else {
+			high = cutoff;
+		}
+	}
+
+	if (best < 0) {
+		best = (targetBytes != 0)?MAX_TARGET_CUTOFF:MIN_TARGET_CUTOFF;
+		if (outputError()) {
+			output << "Could not meet the target, using cutoff " << best << "." << endl;
+		}
+	} else if (outputStd()) {
+		output << "Using cutoff " << best << "." << endl;
+	}
+	return best;
+}
+
+// Applies the decoding options other than the number of threads. Returns
+// whether the fractal was seeded from its thumbnail.
+bool setupDecoder(FractalImage& fractal, bool thumbnailSeed) {
+	fractal.setDecoder(decoder);
+	fractal.setDecodeOrder(decodeOrder);
+	const bool seeded = thumbnailSeed && fractal.seedFromThumbnail();
+	if (lodDepth >= 0 || lodArea > 0) {
+		fractal.setDetailLimit(lodDepth, lodArea);
+	}
+	return seeded;
+}
+
 int decodeImage(const char * in, const char * out, const char* seed) {
+	const bool zoom = (zoomLevels != 0 || zoomTileLevel >= 0);
 	if (out == NULL) {
-		out = DEFAULT_DEC_FNAME;
+		out = (zoomLevels != 0)?DEFAULT_ZOOM_DIR:DEFAULT_DEC_FNAME;
 	}
 
 	if (outputStd()) {
@@ -377,9 +1091,34 @@ int decodeImage(const char * in, const char * out, const char* seed) {
 		gdFree(temp);
 	}
 
+	if (SequenceReader::isSequence(inStream)) {
+		if (regionWidth != 0 && outputError()) {
+			output << "--region does not work with sequences, decoding whole frames." << endl;
+		}
+		if (!sizes.empty() && outputError()) {
+			output << "--sizes does not work with sequences, decoding at " << width << "x" << height << "." << endl;
+		}
+		const int result = decodeSequence(inStream, out, seedImage, seed == NULL);
+		gdFree(seedImage);
+		return result;
+	}
+
+	if (TiledFractal::isTiled(inStream)) {
+		if (!sizes.empty() && outputError()) {
+			output << "--sizes does not work with tiled fractals, decoding at " << width << "x" << height << "." << endl;
+		}
+		const int result = decodeTiled(inStream, out, seedImage, seed == NULL);
+		gdFree(seedImage);
+		return result;
+	}
+
 	DoubleImage img(seedImage, sType, dType, metric, edMethod);
 
 	FractalImage fractal(inStream, img);
+	fractal.setThreads(numThreads);
+	if (setupDecoder(fractal, seed == NULL) && outputVerbose()) {
+		output << "Seeding with the stored thumbnail." << endl;
+	}
 
 	gdFree(seedImage);
 	inStream.close();
@@ -390,28 +1129,29 @@ int decodeImage(const char * in, const char * out, const char* seed) {
 		output << "rendering fractal..." << endl;
 	}
 
-	for (int i = 1; i <= iterations; i++) {
-		if (outputVerbose()) {
-			output << "evaulating iteration #" << i << endl;
-		}
-		DoubleImage result(fractal.decode(fixErrors), sType, dType, metric, edMethod);
-		fractal.setImage(result);
-		if (false) {
-			ostringstream s;
-			s << "e" << i << ".png";
-			string fname = s.str();
-			output << "saving to " << fname << endl;
-			FILE* oimg = fopen(fname.c_str(), "w");
-			if (oimg == NULL) {
-				openError(fname);
-				return 1;
-			}
-			gdImagePng(fractal.getImage().getImage(), oimg);
-			fclose(oimg);
-		}
-		if (outputVerbose()) {
-			output << "Iteration #" << i <<" done." << endl;
+	if (!sizes.empty() && !zoom) {
+		if (regionWidth != 0 && outputError()) {
+			output << "--region does not work with --sizes, decoding whole images." << endl;
 		}
+		return writeSizes(fractal, out);
+	}
+
+	// The window of a region is tied to the full size, so it cannot be
+	// decoded as a pyramid
+	double delta;
+	int used;
+	if (regionWidth != 0 && !zoom) {
+		fractal.setRegion(regionX, regionY, regionWidth, regionHeight);
+		used = decodeIterations(fractal, delta, iterations, getStartTolerance());
+	} else {
+		used = decodePyramid(fractal, delta);
+	}
+	if (outputStd() && tolerance > 0) {
+		output << "Stopped after " << used << " iterations with a change of " << delta << " (rms)." << endl;
+	}
+
+	if (zoom) {
+		return writeZoom(fractal, out);
 	}
 
 	if (outputStd()) {
@@ -425,7 +1165,9 @@ int decodeImage(const char * in, const char * out, const char* seed) {
 		return 1;
 	}
 
-	gdImagePng(fractal.getImage().getImage(), outputImg);
+	gdImagePtr resultImg = fractal.exportImage();
+	gdImagePng(resultImg, outputImg);
+	gdFree(resultImg);
 	fclose(outputImg);
 
 	if (outputStd()) {
@@ -434,6 +1176,501 @@ int decodeImage(const char * in, const char * out, const char* seed) {
 	return 0;
 }
 
+// Decodes every one of --sizes from the same fractal, from the smallest up.
+// Only the smallest is decoded from the seed, and every size after that
+// starts from the one before it scaled up and iterates until a change of
+// --tolerance (or PYRAMID_TOLERANCE), in the same way as the levels of
+// --pyramid. The larger the step up the more passes that takes.
+int writeSizes(FractalImage& fractal, const char* out) {
+	vector<pair<int, int> > ordered;
+	for (vector<pair<int, int> >::const_iterator it = sizes.begin(); it != sizes.end(); it++) {
+		const int h = (it->second != 0)?it->second:max(1, (int)round(((double)it->first) * height / width));
+		ordered.push_back(make_pair(it->first, h));
+	}
+	sort(ordered.begin(), ordered.end());
+	ordered.erase(unique(ordered.begin(), ordered.end()), ordered.end());
+
+
+	for (vector<pair<int, int> >::const_iterator it = ordered.begin(); it != ordered.end(); it++) {
+		const DoubleImage& current = fractal.getImage();
+		gdImagePtr scaled = gdImageCreateTrueColor(it->first, it->second);
+		gdImageCopyResampled(scaled, current.getImage(), 0, 0, 0, 0,
+		                     gdImageSX(scaled), gdImageSY(scaled),
+		                     current.getWidth(), current.getHeight());
+		fractal.setImage(DoubleImage(scaled, sType, dType, metric, edMethod));
+		gdFree(scaled);
+		if (outputStd()) {
+			output << "Decoding at " << it->first << "x" << it->second << "..." << endl;
+		}
+
+		double delta;
+		if (it == ordered.begin()) {
+			const int used = decodePyramid(fractal, delta);
+			if (outputStd() && tolerance > 0) {
+				output << "Stopped after " << used << " iterations with a change of " << delta << " (rms)." << endl;
+			}
+		} else {
+			decodeIterations(fractal, delta, iterations, getUpscaledTolerance());
+		}
+
+		const string name = getSizeFilename(out, it->first, it->second);
+		gdImagePtr result = fractal.exportImage();
+		const bool saved = savePng(result, name);
+		gdFree(result);
+		if (!saved) {
+			return 1;
+		}
+		if (outputStd()) {
+			output << "Saved " << name << "." << endl;
+		}
+	}
+
+	if (outputStd()) {
+		output << "Done." << endl;
+	}
+	return 0;
+}
+
+// Either the first two %d of the name are filled in with the width and then
+// the height, or the width goes before the extension
+string getSizeFilename(const char* out, int width, int height) {
+	string name(out);
+	vector<int> values;
+	values.push_back(width);
+	values.push_back(height);
+	string filled;
+	if (fillNumbers(name, values, filled)) {
+		return filled;
+	}
+	char size[32];
+	snprintf(size, sizeof(size), "-%d", width);
+	const size_t dot = name.rfind('.');
+	const size_t slash = name.rfind('/');
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return name + size;
+	}
+	return name.insert(dot, size);
+}
+
+// Decodes many small images at once, such as thumbnails for a gallery,
+// spreading whole files over the threads rather than one file's pixels.
+// Unless --tolerance is given every file stops iterating once it settles to
+// within BATCH_TOLERANCE. Sequences and tiled fractals are skipped, and so
+// is any file that would be written over the output of one before it.
+int decodeBatch(const vector<string>& files, const char* out, const char* seed) {
+	if (zoomLevels != 0 || zoomTileLevel >= 0) {
+		if (outputError()) {
+			output << "--zoom can not be used with --batch." << endl;
+		}
+		return 1;
+	}
+	if (tolerance <= 0) {
+		tolerance = BATCH_TOLERANCE;
+	}
+	if (out != NULL) {
+		mkdir(out, 0777);
+	}
+
+	// A custom seed is only loaded and resized once
+	gdImagePtr seedImage = NULL;
+	if (seed != NULL) {
+		gdImagePtr temp = NULL;
+		try {
+			temp = loadImage(seed);
+		} catch (const runtime_error& e) {
+			openError(seed, e.what());
+			return 1;
+		}
+		seedImage = gdImageCreateTrueColor(width, height);
+		gdImageCopyResampled(seedImage, temp, 0, 0, 0, 0,
+		                     gdImageSX(seedImage), gdImageSY(seedImage),
+		                     gdImageSX(temp), gdImageSY(temp));
+		gdFree(temp);
+	}
+
+	if (outputStd()) {
+		output << "Decoding " << files.size() << " fractals on ";
+		output << min((size_t)getNumThreads(numThreads), files.size()) << " threads..." << endl;
+	}
+
+	// Files with the same name in different directories would both be
+	// written to the same place, possibly at once
+	vector<char> failed(files.size(), 0);
+	vector<string> names(files.size());
+	map<string, size_t> written;
+	for (size_t i = 0; i < files.size(); i++) {
+		names[i] = getBatchFilename(files[i], out);
+		const pair<map<string, size_t>::iterator, bool> added = written.insert(make_pair(names[i], i));
+		if (!added.second) {
+			if (outputError()) {
+				output << files[i] << " would overwrite " << names[i] << " from " << files[added.first->second] << ", skipping." << endl;
+			}
+			failed[i] = 1;
+		}
+	}
+
+	parallelFor(files.size(), numThreads, [&](size_t i) {
+		if (failed[i]) {
+			return;
+		}
+		const string& in = files[i];
+		ifstream inStream(in.c_str(), ios_base::in | ios_base::binary);
+		if (!inStream.good()) {
+			openError(in);
+			failed[i] = 1;
+			return;
+		}
+		if (SequenceReader::isSequence(inStream) || TiledFractal::isTiled(inStream)) {
+			if (outputError()) {
+				output << in << " is a sequence or tiled, skipping." << endl;
+			}
+			failed[i] = 1;
+			return;
+		}
+
+		gdImagePtr canvas = seedImage;
+		if (canvas == NULL) {
+			inStream.seekg(0, ios::end);
+			const unsigned long length = inStream.tellg();
+			inStream.seekg(0, ios::beg);
+			canvas = blankCanvas(width, height, length);
+		}
+		DoubleImage img(canvas, sType, dType, metric, edMethod);
+		if (canvas != seedImage) {
+			gdFree(canvas);
+		}
+
+		try {
+			// The files are already spread over the threads
+			FractalImage fractal(inStream, img);
+			fractal.setThreads(1);
+			setupDecoder(fractal, seed == NULL);
+			double delta;
+			if (regionWidth != 0) {
+				fractal.setRegion(regionX, regionY, regionWidth, regionHeight);
+				decodeIterations(fractal, delta, iterations, getStartTolerance());
+			} else {
+				decodePyramid(fractal, delta);
+			}
+
+			gdImagePtr result = fractal.exportImage();
+			const string& name = names[i];
+			if (!savePng(result, name)) {
+				failed[i] = 1;
+			} else if (outputVerbose()) {
+				output << in << " -> " << name << endl;
+			}
+			gdFree(result);
+		} catch (const exception& e) {
+			if (outputError()) {
+				output << "Could not decode " << in << " (" << e.what() << ")." << endl;
+			}
+			failed[i] = 1;
+		}
+	});
+	gdFree(seedImage);
+
+	const size_t failures = count(failed.begin(), failed.end(), 1);
+	if (outputStd()) {
+		output << "Done, " << (files.size() - failures) << " of " << files.size() << " decoded." << endl;
+	}
+	return (failures == 0)?0:1;
+}
+
+// The input's name with a .png extension, in the directory out if given and
+// next to the input otherwise
+string getBatchFilename(const string& in, const char* out) {
+	string name = (out != NULL)?string(out) + "/" + getBasename(in):in;
+	const size_t dot = name.rfind('.');
+	const size_t slash = name.rfind('/');
+	if (dot != string::npos && (slash == string::npos || dot > slash)) {
+		name.erase(dot);
+	}
+	return name + ".png";
+}
+
+// The decoded image is level 0 of the pyramid. Either every tile of the
+// first zoomLevels levels is written to out/z/x/y.png, or just the tile
+// given by --zoom-tile to out.
+int writeZoom(FractalImage& fractal, const char* out) {
+	TilePyramid pyramid(fractal, fixErrors);
+	if (zoomTileLevel >= 0) {
+		if (zoomTileLevel > pyramid.getMaxLevel()) {
+			if (outputError()) {
+				output << "Invalid zoom tile." << endl;
+			}
+			return 1;
+		}
+		if (zoomTileX < 0 || zoomTileY < 0 ||
+		    zoomTileX >= pyramid.getColumns(zoomTileLevel) || zoomTileY >= pyramid.getRows(zoomTileLevel)) {
+			if (outputError()) {
+				output << "Zoom level " << zoomTileLevel << " only has " << pyramid.getColumns(zoomTileLevel) << "x" <<
+				          pyramid.getRows(zoomTileLevel) << " tiles." << endl;
+			}
+			return 1;
+		}
+		if (outputStd()) {
+			output << "Rendering tile " << zoomTileLevel << "/" << zoomTileX << "/" << zoomTileY << ", saving to " << out << "..." << endl;
+		}
+		gdImagePtr tile = pyramid.exportTile(zoomTileLevel, zoomTileX, zoomTileY);
+		const bool saved = savePng(tile, out);
+		gdFree(tile);
+		if (!saved) {
+			return 1;
+		}
+	} else {
+		if (zoomLevels > pyramid.getMaxLevel() + 1) {
+			zoomLevels = pyramid.getMaxLevel() + 1;
+			if (outputError()) {
+				output << "Only " << zoomLevels << " zoom levels fit at this size." << endl;
+			}
+		}
+		const string dir(out);
+		mkdir(dir.c_str(), 0777);
+		for (int level = 0; level < zoomLevels; level++) {
+			if (outputStd()) {
+				output << "Rendering zoom level " << level << " (" << pyramid.getLevelWidth(level) << "x" <<
+				          pyramid.getLevelHeight(level) << ")..." << endl;
+			}
+			pyramid.renderLevel(level, numThreads);
+			// Nothing reads from two levels up
+			pyramid.dropLevel(level - 1);
+
+			stringstream levelDir;
+			levelDir << dir << "/" << level;
+			mkdir(levelDir.str().c_str(), 0777);
+			for (int x = 0; x < pyramid.getColumns(level); x++) {
+				stringstream columnDir;
+				columnDir << levelDir.str() << "/" << x;
+				mkdir(columnDir.str().c_str(), 0777);
+				for (int y = 0; y < pyramid.getRows(level); y++) {
+					stringstream filename;
+					filename << columnDir.str() << "/" << y << ".png";
+					gdImagePtr tile = pyramid.exportTile(level, x, y);
+					const bool saved = savePng(tile, filename.str());
+					gdFree(tile);
+					if (!saved) {
+						return 1;
+					}
+				}
+			}
+		}
+	}
+
+	if (outputStd()) {
+		output << "Done." << endl;
+	}
+	return 0;
+}
+
+bool savePng(gdImagePtr image, const string& filename) {
+	FILE* file = fopen(filename.c_str(), "w");
+	if (file == NULL) {
+		openError(filename.c_str());
+		return false;
+	}
+	gdImagePng(image, file);
+	fclose(file);
+	return true;
+}
+
+// Only plain decimal digits are taken, so negative numbers (which strtoul
+// would wrap around) and trailing garbage are refused
+bool parseCount(const char* arg, size_t& value) {
+	if (*arg == '\0') {
+		return false;
+	}
+	for (const char* c = arg; *c != '\0'; c++) {
+		if (!isdigit((unsigned char)*c)) {
+			return false;
+		}
+	}
+	errno = 0;
+	const unsigned long long parsed = strtoull(arg, NULL, 10);
+	if (errno == ERANGE || parsed > numeric_limits<size_t>::max()) {
+		return false;
+	}
+	value = (size_t)parsed;
+	return true;
+}
+
+// Each frame is seeded with the one before it, which is usually most of the
+// way there already
+int decodeSequence(istream& inStream, const char* out, gdImagePtr seedImage, bool thumbnailSeed) {
+	gdImagePtr current = seedImage;
+	size_t frame = 0;
+	try {
+		SequenceReader reader(inStream);
+		while (true) {
+			stringstream serial(ios_base::out|ios_base::in|ios_base::binary);
+			if (!reader.next(serial)) {
+				break;
+			}
+			DoubleImage img(current, sType, dType, metric, edMethod);
+			FractalImage fractal(serial, img);
+			fractal.setThreads(numThreads);
+			// Later frames start from the frame before instead
+			setupDecoder(fractal, thumbnailSeed && frame == 0);
+
+			if (outputStd()) {
+				output << "rendering frame #" << frame << "..." << endl;
+			}
+			double delta;
+			const int used = decodeIterations(fractal, delta, iterations, getStartTolerance());
+			if (outputVerbose() && tolerance > 0) {
+				output << "Frame #" << frame << " stopped after " << used << " iterations (" << delta << " rms)." << endl;
+			}
+
+			const string fname = getFrameFilename(out, frame);
+			FILE* outputImg = fopen(fname.c_str(), "w");
+			if (outputImg == NULL) {
+				openError(fname);
+				if (current != seedImage) {
+					gdFree(current);
+				}
+				return 1;
+			}
+			if (current != seedImage) {
+				gdFree(current);
+			}
+			current = fractal.exportImage();
+			gdImagePng(current, outputImg);
+			fclose(outputImg);
+			frame++;
+		}
+	} catch (const logic_error& e) {
+		if (outputError()) {
+			output << "Could not decode frame #" << frame << " (" << e.what() << ")." << endl;
+		}
+		if (current != seedImage) {
+			gdFree(current);
+		}
+		return 1;
+	}
+	if (current != seedImage) {
+		gdFree(current);
+	}
+
+	if (outputStd()) {
+		output << "Done, " << frame << " frames saved." << endl;
+	}
+	return 0;
+}
+
+static int scaleCoordinate(int coordinate, double scale) {
+	return (int)round(coordinate * scale);
+}
+
+// Every tile is decoded at its share of the output size from its part of the
+// seed, and only its core (without the overlap) is kept
+int decodeTiled(istream& inStream, const char* out, gdImagePtr seedImage, bool thumbnailSeed) {
+	try {
+		TiledFractal tiled(inStream);
+		vector<TiledFractal::Tile>& tiles = tiled.getTiles();
+		const double scaleX = ((double)width) / tiled.getMetadata().getWidth();
+		const double scaleY = ((double)height) / tiled.getMetadata().getHeight();
+
+		if (outputStd()) {
+			output << "tiled fractal loaded (" << tiles.size() << " tiles), rendering..." << endl;
+		}
+
+		// Only the tiles whose cores overlap the region are decoded, each
+		// limited to the part of the region it covers. main() has already
+		// cut the region down to the image.
+		const int outX = (regionWidth != 0)?regionX:0;
+		const int outY = (regionWidth != 0)?regionY:0;
+		const int outWidth = (regionWidth != 0)?regionWidth:width;
+		const int outHeight = (regionWidth != 0)?regionHeight:height;
+		gdImagePtr result = gdImageCreateTrueColor(outWidth, outHeight);
+		parallelFor(tiles.size(), numThreads, [&](size_t i) {
+			TiledFractal::Tile& tile = tiles[i];
+			const int coreX = scaleCoordinate(tile.coreX, scaleX);
+			const int coreY = scaleCoordinate(tile.coreY, scaleY);
+			const int left = max(coreX, outX);
+			const int top = max(coreY, outY);
+			const int right = min(scaleCoordinate(tile.coreX + tile.coreWidth, scaleX), outX + outWidth);
+			const int bottom = min(scaleCoordinate(tile.coreY + tile.coreHeight, scaleY), outY + outHeight);
+			if (left >= right || top >= bottom) {
+				return;
+			}
+
+			const int x = scaleCoordinate(tile.x, scaleX);
+			const int y = scaleCoordinate(tile.y, scaleY);
+			const int w = max(2, scaleCoordinate(tile.x + tile.width, scaleX) - x);
+			const int h = max(2, scaleCoordinate(tile.y + tile.height, scaleY) - y);
+
+			gdImagePtr seedCrop = gdImageCreateTrueColor(w, h);
+			gdImageCopy(seedCrop, seedImage, 0, 0, x, y, w, h);
+			DoubleImage img(seedCrop, sType, dType, metric, edMethod);
+			gdFree(seedCrop);
+
+			// The tiles are already spread over the threads, so each one
+			// decodes on a single thread
+			istringstream serial(tile.fractal, ios_base::in|ios_base::binary);
+			FractalImage fractal(serial, img);
+			setupDecoder(fractal, thumbnailSeed);
+			if (regionWidth != 0) {
+				fractal.setRegion(left - x, top - y, right - left, bottom - top);
+			}
+			double delta;
+			decodeIterations(fractal, delta, iterations, getStartTolerance());
+
+			// With a region set only that part is exported
+			const int fromX = (regionWidth != 0)?0:left - x;
+			const int fromY = (regionWidth != 0)?0:top - y;
+			gdImagePtr rendered = fractal.exportImage();
+			gdImageCopy(result, rendered, left - outX, top - outY, fromX, fromY, right - left, bottom - top);
+			gdFree(rendered);
+
+			if (outputVerbose()) {
+				output << "Tile #" << i << " done." << endl;
+			}
+		});
+
+		if (outputStd()) {
+			output << "Rendering done, saving to " << out << "..." << endl;
+		}
+
+		FILE* outputImg = fopen(out, "w");
+		if (outputImg == NULL) {
+			openError(out);
+			gdFree(result);
+			return 1;
+		}
+		gdImagePng(result, outputImg);
+		fclose(outputImg);
+		gdFree(result);
+	} catch (const logic_error& e) {
+		if (outputError()) {
+			output << "Could not decode tiled fractal (" << e.what() << ")." << endl;
+		}
+		return 1;
+	}
+
+	if (outputStd()) {
+		output << "Done." << endl;
+	}
+	return 0;
+}
+
+// Either the first %d of the name (e.g. %03d) is filled in with the number
+// or it goes before the extension
+string getFrameFilename(const char* out, size_t frame) {
+	string name(out);
+	string filled;
+	if (fillNumbers(name, vector<int>(1, (int)frame), filled)) {
+		return filled;
+	}
+	char number[32];
+	snprintf(number, sizeof(number), "%04d", (int)frame);
+	const size_t dot = name.rfind('.');
+	const size_t slash = name.rfind('/');
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return name + number;
+	}
+	return name.insert(dot, number);
+}
+
 int printHelp() {
 	const string defaultMsg = " This is the default.";
 
@@ -441,6 +1678,8 @@ int printHelp() {
 	output << "This program is used for encoding and decoding triangular fractal images." << endl;
 	output << endl;
 	output << "Usage: fractal [OPTIONS] [INPUTFILE]" << endl;
+	output << "A directory of images or a .y4m file is encoded as a sequence, and a sequence" << endl;
+	output << "decodes to one numbered image per frame." << endl;
 	output << "General Options:" << endl;
 	output << "  -H, --help           Print this help message." << endl;
 	output << "  -V, --version        Print version information." << endl;
@@ -450,6 +1689,8 @@ int printHelp() {
 	output << "  -o, --output=fname   Output file." << endl;
 	output << "  -v, --verbose        Print verbose output (twice for debug)." << endl;
 	output << "  -q, --quiet          Surpress all output." << endl;
+	output << "  -j, --threads=num    Number of threads for tiled images and decoding" << endl;
+	output << "                       (0 for one per core). Default: " << DEFAULT_THREADS << endl;
 	output << "      --sample=type    Sets sampling mode. Options are:" << endl;
 	output << "                         \"sub\" - Subsampling, few errors.";
 	if (DEFAULT_SAMPLING_TYPE == DoubleImage::T_SUBSAMPLE) {
@@ -473,14 +1714,86 @@ int printHelp() {
 	output << "  -s, --seed=fname     Specify a custom seed image. (resized to w,h)" << endl;
 	output << "  -i, --iterations=num Set the number of iterations for decoding. Default: " << DEFAULT_ITERATIONS << endl;
 	output << "      --(no-)fixerrors Interpolate (or not) to fix errors. Default is " << (DEFAULT_FIX_ERRORS?"fix":"don't fix") << "." << endl;
+	output << "      --tolerance=float Stop iterating once an iteration changes the image by" << endl;
+	output << "                       less than float (rms), with -i as the limit. Default: " << DEFAULT_TOLERANCE << endl;
+	output << "      --pyramid=num    Run the iterations at 1/2^(num-1) of the size, then double" << endl;
+	output << "                       it, iterating at each size until a change of --tolerance" << endl;
+	output << "                       (" << PYRAMID_TOLERANCE << " if not given) with -i as the limit. Default: " << DEFAULT_PYRAMID_LEVELS << endl;
+	output << "      --region=x,y,w,h Only decode the w by h pixels at x,y of the output size," << endl;
+	output << "                       along with the triangles they depend on." << endl;
+	output << "      --sizes=w[xh],... Write the fractal at each of these sizes, inserting the" << endl;
+	output << "                       width before the extension of -o (or filling in a %d" << endl;
+	output << "                       pattern). A size without a height keeps the -w by -h ratio." << endl;
+	output << "      --batch          Decode every fractal given, or every file named on stdin" << endl;
+	output << "                       if none are, on --threads threads, writing name.png to the" << endl;
+	output << "                       -o directory or next to each fractal. Stops iterating at" << endl;
+	output << "                       a change of " << BATCH_TOLERANCE << " unless --tolerance is given." << endl;
+	output << "      --lod-depth=num  Preview from the top num levels of triangles only, fitted" << endl;
+	output << "                       to a small decode of the rest. Default: all" << endl;
+	output << "      --lod-area=float Likewise stop above triangles smaller than float of the" << endl;
+	output << "                       image area. Default: 0. Both stop iterating at a change" << endl;
+	output << "                       of " << PYRAMID_TOLERANCE << " unless --tolerance is given." << endl;
+	output << "      --zoom=levels    Write a pyramid of tiles to the output directory as" << endl;
+	output << "                       z/x/y.png, where level 0 is the -w by -h decode and every" << endl;
+	output << "                       level doubles the size. Default directory: " << DEFAULT_ZOOM_DIR << endl;
+	output << "      --zoom-tile=z/x/y Only write that tile of the pyramid to the output file." << endl;
+	output << "      --decoder=type   Sets how iterations are rendered. Options are:" << endl;
+	output << "                         \"direct\" - Map every triangle's points each iteration.";
+	if (DEFAULT_DECODER == FractalImage::D_DIRECT) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "                         \"compiled\" - Work out the mapping once and replay it.";
+	if (DEFAULT_DECODER == FractalImage::D_COMPILED) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "                         \"pingpong\" - Like compiled, but render into two reused" << endl;
+	output << "                         buffers instead of a new image per iteration.";
+	if (DEFAULT_DECODER == FractalImage::D_PINGPONG) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "                         \"inplace\" - Update the image in place so triangles see the" << endl;
+	output << "                         values already written this iteration. Converges in" << endl;
+	output << "                         fewer iterations, but uses only one thread.";
+	if (DEFAULT_DECODER == FractalImage::D_INPLACE) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "      --decode-order=type Sets the triangle order for --decoder=inplace. Options are:" << endl;
+	output << "                         \"tree\" - The order of the tree.";
+	if (DEFAULT_DECODE_ORDER == DecodePlan::O_TREE) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "                         \"dependency\" - Triangles after those their domain reads.";
+	if (DEFAULT_DECODE_ORDER == DecodePlan::O_DEPENDENCY) {
+		output << defaultMsg;
+	}
+	output << endl;
 	output << endl;
 	output << "Encoding Options:" << endl;
 	output << "  -c, --cutoff=float   Set the error cutoff (rms intensity). Default: " << DEFAULT_ERROR_CUTOFF << endl;
+	output << "      --thumbnail=num  Store the image shrunk to num pixels across (1 for just the" << endl;
+	output << "                       mean) to start decoding from. 0 for none. Default: " << DEFAULT_THUMBNAIL_SIZE << endl;
 	output << "  -C, --color          Encode in RGB colorspace.";
 	if (DEFAULT_COLOR_MODE == FractalImage::T_COLOR) {
 		output << defaultMsg;
 	}
 	output << endl;
+	output << "      --shared-color   Encode in RGB colorspace with one tree for all channels.";
+	if (DEFAULT_COLOR_MODE == FractalImage::T_SHAREDCOLOR) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "      --ycbcr          Encode in YCbCr colorspace.";
+	if (DEFAULT_COLOR_MODE == FractalImage::T_YCBCR) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "      --chroma-scale=float Multiply the cutoff for chroma by float, e.g. 1.5 for" << endl;
+	output << "                       a smaller, blurrier file. Default: " << DEFAULT_CHROMA_SCALE << endl;
 	output << "  -G, --greyscale      Encode in greyscale.";
 	if (DEFAULT_COLOR_MODE == FractalImage::T_GREYSCALE) {
 		output << defaultMsg;
@@ -524,6 +1837,30 @@ int printHelp() {
 		output << defaultMsg;
 	}
 	output << endl;
+	output << "      --order=type     Sets the order triangles are refined in. Options are:" << endl;
+	output << "                         \"breadth\" - Refine in creation order.";
+	if (DEFAULT_SUBDIVISION_ORDER == TriangleTree::O_BREADTHFIRST) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "                         \"best\" - Refine the worst fitting triangle first.";
+	if (DEFAULT_SUBDIVISION_ORDER == TriangleTree::O_BESTFIRST) {
+		output << defaultMsg;
+	}
+	output << endl;
+	output << "      --max-triangles=num Stop refining after num triangles. (implies --order=best)" << endl;
+	output << "      --max-bytes=num  Stop refining when the fractal would exceed num bytes." << endl;
+	output << "                       (implies --order=best)" << endl;
+	output << "      --target-psnr=db Search for the loosest cutoff that decodes to at least db." << endl;
+	output << "      --target-bytes=num Search for the tightest cutoff that fits in num bytes." << endl;
+	output << "      --checkpoint[=fname] Periodically save the encoder state to fname." << endl;
+	output << "                       Default: the output file with " << DEFAULT_CHECKPOINT_SUFFIX << " appended." << endl;
+	output << "      --checkpoint-interval=secs Seconds between checkpoints. Default: " << DEFAULT_CHECKPOINT_INTERVAL << endl;
+	output << "      --resume         Continue from the checkpoint if there is one. The options it" << endl;
+	output << "                       was started with are used. (implies --checkpoint)" << endl;
+	output << "      --tile=size      Encode in independent tiles of about size pixels square," << endl;
+	output << "                       which bounds the memory used by the encoder." << endl;
+	output << "      --tile-overlap=num Extend each tile by num pixels to hide seams. Default: " << DEFAULT_TILE_OVERLAP << endl;
 	output << "      --edges=func     Sets the edge detection method. Options are:" << endl;
 	output << "                         \"sobel\" - Sobel filter.";
 	if (DEFAULT_EDGE_DETECTION_METHOD == DoubleImage::M_SOBEL) {
@@ -552,6 +1889,10 @@ int infoImage(const char* in) {
 		return 1;
 	}
 
+	if (TiledFractal::isTiled(inStream)) {
+		return infoTiled(inStream);
+	}
+
 	FractalImage fractal(inStream, DoubleImage());
 
 	inStream.close();
@@ -563,6 +1904,9 @@ int infoImage(const char* in) {
 	output << "    Width:" << fractal.getMetadata().getWidth() << endl;
 	output << "    Height:" << fractal.getMetadata().getHeight() << endl;
 	output << "    Filename:" << fractal.getMetadata().getSourceFilename() << endl;
+	if (fractal.getMetadata().hasThumbnail()) {
+		output << "    Thumbnail:" << fractal.getMetadata().getThumbnailWidth() << "x" << fractal.getMetadata().getThumbnailHeight() << endl;
+	}
 	output << endl;
 
 	output << "Num Channels: " << fractal.getChannels().size() << endl;
@@ -574,6 +1918,30 @@ int infoImage(const char* in) {
 	return 0;
 }
 
+int infoTiled(istream& inStream) {
+	TiledFractal tiled(inStream);
+	vector<TiledFractal::Tile>& tiles = tiled.getTiles();
+
+	output << "tiled fractal loaded. (" << tiles.size() << " tiles)" << endl;
+
+	output << "Metadata:" << endl;
+
+	output << "    Width:" << tiled.getMetadata().getWidth() << endl;
+	output << "    Height:" << tiled.getMetadata().getHeight() << endl;
+	output << "    Filename:" << tiled.getMetadata().getSourceFilename() << endl;
+	output << endl;
+
+	for (vector<TiledFractal::Tile>::size_type i = 0; i < tiles.size(); i++) {
+		istringstream serial(tiles[i].fractal, ios_base::in|ios_base::binary);
+		FractalImage fractal(serial, DoubleImage());
+		output << "Tile #" << i << " (" << tiles[i].x << "," << tiles[i].y << " ";
+		output << tiles[i].width << "x" << tiles[i].height << "): ";
+		output << fractal.getSize() << " triangles, " << tiles[i].fractal.size() << " bytes" << endl;
+	}
+
+	return 0;
+}
+
 int printVersion() {
 	output << name << " " << version << endl;
 	output << "Copyright (C) 2011 Allan Wirth" << endl;
@@ -19,7 +19,11 @@
  */
 #include "metadata.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 #include "ioutils.h"
+#include "imageutils.h"
 
 using namespace std;
 
@@ -27,12 +31,20 @@ MetaData::MetaData() {
 	width = 0;
 	height = 0;
 	sourceFilename = "";
+	thumbnailWidth = 0;
+	thumbnailHeight = 0;
+	thumbnailComponents = 0;
 }
 
+// The thumbnail is not part of the metadata proper, see
+// unserializeThumbnail()
 MetaData::MetaData(istream& in) {
 	width = unserializeSignedInt(in);
 	height = unserializeSignedInt(in);
 	sourceFilename = unserializeString(in);
+	thumbnailWidth = 0;
+	thumbnailHeight = 0;
+	thumbnailComponents = 0;
 }
 
 MetaData& MetaData::operator=(const MetaData& other) {
@@ -40,6 +52,10 @@ MetaData& MetaData::operator=(const MetaData& other) {
 		this->width = other.width;
 		this->height = other.height;
 		this->sourceFilename = other.sourceFilename;
+		this->thumbnailWidth = other.thumbnailWidth;
+		this->thumbnailHeight = other.thumbnailHeight;
+		this->thumbnailComponents = other.thumbnailComponents;
+		this->thumbnail = other.thumbnail;
 	}
 	return *this;
 }
@@ -68,8 +84,108 @@ void MetaData::setSourceFilename(string filename) {
 	this->sourceFilename = filename;
 }
 
+bool MetaData::hasThumbnail() const {
+	return !thumbnail.empty();
+}
+
+int MetaData::getThumbnailWidth() const {
+	return thumbnailWidth;
+}
+
+int MetaData::getThumbnailHeight() const {
+	return thumbnailHeight;
+}
+
+// Shrinks image to at most maxSize pixels on its longer side, keeping the
+// aspect ratio. A maxSize of one keeps just the mean of every channel. The
+// pixels are stored as they are, so for YCbCr images the thumbnail is YCbCr
+// too.
+void MetaData::setThumbnail(const gdImagePtr image, int maxSize, bool grey) {
+	const int longer = max(gdImageSX(image), gdImageSY(image));
+	// Never larger than the image itself
+	maxSize = min(maxSize, min(longer, MAX_THUMBNAIL_SIZE));
+	thumbnailWidth = max(1, (int)((double)maxSize * gdImageSX(image) / longer + 0.5));
+	thumbnailHeight = max(1, (int)((double)maxSize * gdImageSY(image) / longer + 0.5));
+	thumbnailComponents = grey?1:3;
+
+	gdImagePtr small = gdImageCreateTrueColor(thumbnailWidth, thumbnailHeight);
+	gdImageCopyResampled(small, image, 0, 0, 0, 0, thumbnailWidth, thumbnailHeight,
+	                     gdImageSX(image), gdImageSY(image));
+	thumbnail.clear();
+	for (int y = 0; y < thumbnailHeight; y++) {
+		for (int x = 0; x < thumbnailWidth; x++) {
+			if (grey) {
+				thumbnail.push_back(getPixel(small, x, y, C_GREY, false));
+			} else {
+				thumbnail.push_back(getPixel(small, x, y, C_RED, false));
+				thumbnail.push_back(getPixel(small, x, y, C_GREEN, false));
+				thumbnail.push_back(getPixel(small, x, y, C_BLUE, false));
+			}
+		}
+	}
+	gdFree(small);
+}
+
+// Returns a new image of the thumbnail which the caller must free
+gdImagePtr MetaData::getThumbnail() const {
+	gdImagePtr result = gdImageCreateTrueColor(thumbnailWidth, thumbnailHeight);
+	string::const_iterator it = thumbnail.begin();
+	for (int y = 0; y < thumbnailHeight; y++) {
+		for (int x = 0; x < thumbnailWidth; x++) {
+			if (thumbnailComponents == 1) {
+				setPixel(result, x, y, *it++, C_GREY);
+			} else {
+				setPixel(result, x, y, *it++, C_RED);
+				setPixel(result, x, y, *it++, C_GREEN);
+				setPixel(result, x, y, *it++, C_BLUE);
+			}
+		}
+	}
+	return result;
+}
+
 void MetaData::serialize(ostream& out) const {
 	serializeSignedInt(out, width);
 	serializeSignedInt(out, height);
 	serializeString(out, sourceFilename);
 }
+
+// Must be kept in sync with serialize()
+size_t MetaData::getSerializedSize() const {
+	return 4 + 4 + 2 + sourceFilename.size();
+}
+
+// Only written when there is a thumbnail, whoever stores the metadata has to
+// record whether it follows
+void MetaData::serializeThumbnail(ostream& out) const {
+	out << "THMB";
+	serializeUnsignedShort(out, thumbnailWidth);
+	serializeUnsignedShort(out, thumbnailHeight);
+	out.put(thumbnailComponents);
+	out << thumbnail;
+}
+
+void MetaData::unserializeThumbnail(istream& in) {
+	char magic[5];
+	in.read(magic, 4);
+	magic[4] = '\0';
+	if (!(string("THMB") == magic)) {
+		throw logic_error("NOT VALID THUMBNAIL");
+	}
+	thumbnailWidth = unserializeUnsignedShort(in);
+	thumbnailHeight = unserializeUnsignedShort(in);
+	thumbnailComponents = in.get();
+	if (thumbnailWidth == 0 || thumbnailHeight == 0 || (thumbnailComponents != 1 && thumbnailComponents != 3)) {
+		throw logic_error("NOT VALID THUMBNAIL");
+	}
+	thumbnail.resize((size_t)thumbnailWidth * thumbnailHeight * thumbnailComponents);
+	in.read(&thumbnail[0], thumbnail.size());
+	if (!in.good()) {
+		throw logic_error("NOT VALID THUMBNAIL");
+	}
+}
+
+// Must be kept in sync with serializeThumbnail()
+size_t MetaData::getThumbnailSize() const {
+	return hasThumbnail()?(4 + 2 + 2 + 1 + thumbnail.size()):0;
+}
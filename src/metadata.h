@@ -20,16 +20,25 @@
 #ifndef _METADATA_H
 #define _METADATA_H
 
+#include <cstddef>
 #include <string>
 #include <istream>
 #include <ostream>
+#include "gd.h"
 
 class MetaData {
 private:
 	int width;
 	int height;
 	std::string sourceFilename;
+	int thumbnailWidth;
+	int thumbnailHeight;
+	unsigned char thumbnailComponents;
+	std::string thumbnail;
 public:
+	// The thumbnail's width and height are stored as shorts
+	static const int MAX_THUMBNAIL_SIZE = 0xFFFF;
+
 	MetaData();
 	MetaData(std::istream& in);
 
@@ -39,10 +48,19 @@ public:
 	void setHeight(int height);
 	std::string getSourceFilename() const;
 	void setSourceFilename(std::string filename);
+	bool hasThumbnail() const;
+	int getThumbnailWidth() const;
+	int getThumbnailHeight() const;
+	void setThumbnail(const gdImagePtr image, int maxSize, bool grey);
+	gdImagePtr getThumbnail() const;
 
 	MetaData& operator=(const MetaData& other);
 
 	void serialize(std::ostream& out) const;
+	std::size_t getSerializedSize() const;
+	void serializeThumbnail(std::ostream& out) const;
+	void unserializeThumbnail(std::istream& in);
+	std::size_t getThumbnailSize() const;
 };
 
 #endif
@@ -59,6 +59,17 @@ bool Rectangle::pointInside(const Point2D& point) const {
 			 (px <= this->y+this->h || doublesEqual(py, this->y+this->h))));
 }
 
+// Rectangles that only touch count as intersecting
+bool Rectangle::intersects(const Rectangle& other) const {
+	return other.x <= this->x+this->w && this->x <= other.x+other.w &&
+	       other.y <= this->y+this->h && this->y <= other.y+other.h;
+}
+
+// Grown by dx on the left and right and dy on the top and bottom
+Rectangle Rectangle::expand(double dx, double dy) const {
+	return Rectangle(this->x-dx, this->y-dy, this->w+2*dx, this->h+2*dy);
+}
+
 std::string Rectangle::str () const {
 	std::ostringstream s;
 	s << "(X:" << this->x << ",Y:" << this->y << ", W:" << this->w << ", H:" << this->h << ")";
@@ -42,6 +42,8 @@ public:
 	double getBottom() const;
 	double getArea() const;
 	bool pointInside(const Point2D& point) const;
+	bool intersects(const Rectangle& other) const;
+	Rectangle expand(double dx, double dy) const;
 	std::string str() const;
 };
 #endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "threadutils.h"
+
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <exception>
+
+using namespace std;
+
+// 0 means one thread per core
+unsigned int getNumThreads(unsigned int threads) {
+	if (threads == 0) {
+		threads = thread::hardware_concurrency();
+	}
+	return (threads == 0)?1:threads;
+}
+
+// Calls body for every index below count, handing the indices out in order to
+// whichever thread is free. The first exception thrown by body is rethrown
+// once every thread has stopped.
+void parallelFor(size_t count, unsigned int threads, const function<void(size_t)>& body) {
+	threads = getNumThreads(threads);
+	if (threads > count) {
+		threads = count;
+	}
+	if (threads <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			body(i);
+		}
+		return;
+	}
+
+	mutex lock;
+	size_t next = 0;
+	exception_ptr error;
+
+	vector<thread> workers;
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.push_back(thread([&]() {
+			while (true) {
+				size_t i;
+				{
+					lock_guard<mutex> guard(lock);
+					if (next == count || error) {
+						return;
+					}
+					i = next++;
+				}
+				try {
+					body(i);
+				} catch (...) {
+					lock_guard<mutex> guard(lock);
+					if (!error) {
+						error = current_exception();
+					}
+				}
+			}
+		}));
+	}
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+		it->join();
+	}
+	if (error) {
+		rethrow_exception(error);
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tiledfractal.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "ioutils.h"
+
+using namespace std;
+
+// Splits length into spans of roughly tileSize, all within a pixel of each
+// other so that there are no slivers at the end
+vector<int> TiledFractal::split(int length, int tileSize) {
+	int count = (length + tileSize / 2) / tileSize;
+	if (count < 1) {
+		count = 1;
+	}
+	vector<int> bounds;
+	for (int i = 0; i <= count; i++) {
+		bounds.push_back((int)((long long)length * i / count));
+	}
+	return bounds;
+}
+
+TiledFractal::TiledFractal(int width, int height, int tileSize, int overlap) {
+	metadata.setWidth(width);
+	metadata.setHeight(height);
+	const vector<int> xs = split(width, tileSize);
+	const vector<int> ys = split(height, tileSize);
+	for (vector<int>::size_type j = 0; j + 1 < ys.size(); j++) {
+		for (vector<int>::size_type i = 0; i + 1 < xs.size(); i++) {
+			Tile tile;
+			tile.coreX = xs[i];
+			tile.coreY = ys[j];
+			tile.coreWidth = xs[i + 1] - xs[i];
+			tile.coreHeight = ys[j + 1] - ys[j];
+			tile.x = max(0, tile.coreX - overlap);
+			tile.y = max(0, tile.coreY - overlap);
+			tile.width = min(width, tile.coreX + tile.coreWidth + overlap) - tile.x;
+			tile.height = min(height, tile.coreY + tile.coreHeight + overlap) - tile.y;
+			tiles.push_back(tile);
+		}
+	}
+}
+
+TiledFractal::TiledFractal(istream& in) {
+	char magic[9];
+	in.read(magic, 8);
+	magic[8] = '\0';
+	if (!(string("FRACTILE") == magic)) {
+		throw logic_error("NOT VALID TILED FILE");
+	}
+
+	metadata = MetaData(in);
+
+	const int numTiles = unserializeSignedInt(in);
+	for (int i = 0; i < numTiles && in.good(); i++) {
+		Tile tile;
+		tile.x = unserializeSignedInt(in);
+		tile.y = unserializeSignedInt(in);
+		tile.width = unserializeSignedInt(in);
+		tile.height = unserializeSignedInt(in);
+		tile.coreX = unserializeSignedInt(in);
+		tile.coreY = unserializeSignedInt(in);
+		tile.coreWidth = unserializeSignedInt(in);
+		tile.coreHeight = unserializeSignedInt(in);
+		const int length = unserializeSignedInt(in);
+		if (length < 0) {
+			throw logic_error("NOT VALID TILED FILE");
+		}
+		tile.fractal.resize(length);
+		in.read(&tile.fractal[0], length);
+		tiles.push_back(tile);
+	}
+	if (!in.good()) {
+		throw logic_error("NOT VALID TILED FILE");
+	}
+}
+
+MetaData& TiledFractal::getMetadata() {
+	return metadata;
+}
+
+vector<TiledFractal::Tile>& TiledFractal::getTiles() {
+	return tiles;
+}
+
+void TiledFractal::serialize(ostream& out) const {
+	out << "FRACTILE";
+
+	metadata.serialize(out);
+
+	serializeSignedInt(out, tiles.size());
+	for (vector<Tile>::const_iterator it = tiles.begin(); it != tiles.end(); it++) {
+		serializeSignedInt(out, it->x);
+		serializeSignedInt(out, it->y);
+		serializeSignedInt(out, it->width);
+		serializeSignedInt(out, it->height);
+		serializeSignedInt(out, it->coreX);
+		serializeSignedInt(out, it->coreY);
+		serializeSignedInt(out, it->coreWidth);
+		serializeSignedInt(out, it->coreHeight);
+		serializeSignedInt(out, it->fractal.size());
+		out << it->fractal;
+	}
+}
+
+bool TiledFractal::isTiled(istream& in) {
+	char magic[9];
+	in.read(magic, 8);
+	magic[8] = '\0';
+	const bool result = in.good() && string("FRACTILE") == magic;
+	in.clear();
+	in.seekg(0, ios::beg);
+	return result;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TILEDFRACTAL_H
+#define _TILEDFRACTAL_H
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <ostream>
+
+#include "metadata.h"
+
+// A large image encoded as a grid of independent fractals, so that only one
+// tile per thread has to be held in memory while encoding or decoding.
+class TiledFractal {
+public:
+	struct Tile {
+		// The area that was encoded, which includes the overlap
+		int x;
+		int y;
+		int width;
+		int height;
+		// The part of it that this tile is responsible for when decoding
+		int coreX;
+		int coreY;
+		int coreWidth;
+		int coreHeight;
+		std::string fractal;
+	};
+private:
+	MetaData metadata;
+	std::vector<Tile> tiles;
+
+	static std::vector<int> split(int length, int tileSize);
+public:
+	TiledFractal(int width, int height, int tileSize, int overlap);
+	TiledFractal(std::istream& in);
+	MetaData& getMetadata();
+	std::vector<Tile>& getTiles();
+	void serialize(std::ostream& out) const;
+
+	static bool isTiled(std::istream& in);
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tilepyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "accumulationbuffer.h"
+#include "constant.h"
+#include "mathutils.h"
+#include "output.h"
+#include "threadutils.h"
+
+using namespace std;
+
+TilePyramid::ChannelMapping::ChannelMapping(const TriangleTree* tree) : channel(tree->getChannel()),
+	index(tree->getLeaves()) {
+	transforms.reserve(index.getSize());
+	for (size_t i = 0; i < index.getSize(); i++) {
+		const Triangle* t = index.getTriangle(i);
+		const TriFit fit = t->getTarget();
+		transforms.push_back(AffineTransform(*t, *fit.best, fit.pMap));
+	}
+}
+
+TilePyramid::Cursor::Cursor() : x(-1), y(-1), tile(NULL) {
+}
+
+// Level 0 is the current image of fractal, which should already be decoded
+TilePyramid::TilePyramid(const FractalImage& fractal, bool fixErrors) : type(fractal.getType()),
+	baseWidth(fractal.getImage().getWidth()), baseHeight(fractal.getImage().getHeight()), fixErrors(fixErrors) {
+	tileSize = max(baseWidth, baseHeight);
+	const vector<TriangleTree*>& trees = fractal.getChannels();
+	for (vector<TriangleTree*>::const_iterator it = trees.begin(); it != trees.end(); it++) {
+		channels.push_back(ChannelMapping(*it));
+	}
+	addLevels(0);
+	gdImagePtr base = gdImageCreateTrueColor(baseWidth, baseHeight);
+	gdImageCopy(base, fractal.getImage().getImage(), 0, 0, 0, 0, baseWidth, baseHeight);
+	levels[0][make_pair(0, 0)] = base;
+	complete[0] = true;
+}
+
+TilePyramid::~TilePyramid() {
+	for (vector<Level>::size_type i = 0; i < levels.size(); i++) {
+		dropLevel(i);
+	}
+}
+
+int TilePyramid::getTileSize() const {
+	return tileSize;
+}
+
+// The deepest level whose size, rounded up to whole tiles, still fits in
+// an int
+int TilePyramid::getMaxLevel() const {
+	const int size = max(baseWidth, baseHeight);
+	int level = 0;
+	while (size <= (numeric_limits<int>::max() - tileSize) >> (level + 1)) {
+		level++;
+	}
+	return level;
+}
+
+int TilePyramid::getLevelWidth(int level) const {
+	return baseWidth << level;
+}
+
+int TilePyramid::getLevelHeight(int level) const {
+	return baseHeight << level;
+}
+
+int TilePyramid::getColumns(int level) const {
+	return (getLevelWidth(level) + tileSize - 1) / tileSize;
+}
+
+int TilePyramid::getRows(int level) const {
+	return (getLevelHeight(level) + tileSize - 1) / tileSize;
+}
+
+void TilePyramid::addLevels(int level) {
+	if (level >= (int)levels.size()) {
+		levels.resize(level + 1);
+		complete.resize(level + 1, false);
+	}
+}
+
+// Renders the tile and the tiles it reads from first if they are not kept
+// already. Only renders on one thread.
+gdImagePtr TilePyramid::getTile(int level, int x, int y) {
+	if (x < 0 || y < 0 || x >= getColumns(level) || y >= getRows(level)) {
+		throw logic_error("tile is outside the image");
+	}
+	addLevels(level);
+	Level::iterator it = levels[level].find(make_pair(x, y));
+	if (it != levels[level].end() && it->second != NULL) {
+		return it->second;
+	}
+	gdImagePtr tile = renderTile(level, x, y);
+	levels[level][make_pair(x, y)] = tile;
+	return tile;
+}
+
+// Returns a new RGB copy of a tile which the caller must free
+gdImagePtr TilePyramid::exportTile(int level, int x, int y) {
+	gdImagePtr tile = getTile(level, x, y);
+	gdImagePtr result = gdImageCreateTrueColor(gdImageSX(tile), gdImageSY(tile));
+	gdImageCopy(result, tile, 0, 0, 0, 0, gdImageSX(tile), gdImageSY(tile));
+	if (type == FractalImage::T_YCBCR) {
+		convertFromYCbCr(result);
+	}
+	return result;
+}
+
+// Renders every tile of a level on threads threads, once the levels above it
+// are done. Tiles only read from the level above, which is left alone while
+// they render.
+void TilePyramid::renderLevel(int level, unsigned int threads) {
+	addLevels(level);
+	if (complete[level]) {
+		return;
+	}
+	if (level > 0) {
+		renderLevel(level - 1, threads);
+	}
+	const int columns = getColumns(level);
+	const int rows = getRows(level);
+	vector<Level::iterator> missing;
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			Level::iterator it = levels[level].insert(make_pair(make_pair(x, y), (gdImagePtr)NULL)).first;
+			if (it->second == NULL) {
+				missing.push_back(it);
+			}
+		}
+	}
+	parallelFor(missing.size(), threads, [&](size_t i) {
+		missing[i]->second = renderTile(level, missing[i]->first.first, missing[i]->first.second);
+	});
+	complete[level] = true;
+	if (outputVerbose()) {
+		output << "Rendered zoom level " << level << " (" << columns << "x" << rows << " tiles)." << endl;
+	}
+}
+
+// Frees the tiles of a level, which are rendered again if they are needed
+void TilePyramid::dropLevel(int level) {
+	if (level < 0 || level >= (int)levels.size()) {
+		return;
+	}
+	for (Level::iterator it = levels[level].begin(); it != levels[level].end(); it++) {
+		if (it->second != NULL) {
+			gdFree(it->second);
+		}
+	}
+	levels[level].clear();
+	complete[level] = false;
+}
+
+// Maps every pixel of the tile from the point its triangle maps it to in the
+// level above, as a subsampled decode iteration would. The triangles are
+// found through the index, and only the part of each one inside the tile is
+// scanned. The tile is rendered with TILE_BORDER pixels of its neighbours
+// around it, so that holes along its edges are filled from the pixels next
+// to them rather than from the far side of the tile.
+gdImagePtr TilePyramid::renderTile(int level, int x, int y) {
+	if (level == 0) {
+		throw logic_error("level 0 is not rendered from tiles");
+	}
+	const int width = getLevelWidth(level);
+	const int height = getLevelHeight(level);
+	const int tileLeft = x * tileSize;
+	const int tileTop = y * tileSize;
+	const int tileWidth = min(tileSize, width - tileLeft);
+	const int tileHeight = min(tileSize, height - tileTop);
+	const int left = max(0, tileLeft - TILE_BORDER);
+	const int top = max(0, tileTop - TILE_BORDER);
+	const int w = min(width, tileLeft + tileWidth + TILE_BORDER) - left;
+	const int h = min(height, tileTop + tileHeight + TILE_BORDER) - top;
+	const double xInc = 1.0 / (width - 1);
+	const double yInc = 1.0 / (height - 1);
+	const Rectangle area(left * xInc, top * yInc, (w - 1) * xInc, (h - 1) * yInc);
+
+	gdImagePtr padded = gdImageCreateTrueColor(w, h);
+	gdImageAlphaBlending(padded, 0);
+	gdImageSaveAlpha(padded, 1);
+	for (vector<ChannelMapping>::const_iterator it = channels.begin(); it != channels.end(); it++) {
+		const unsigned char components = getNumComponents(it->channel);
+		AccumulationBuffer buffer(w, h, components);
+		Cursor cursor;
+		const vector<size_t> found = it->index.find(area);
+		for (vector<size_t>::const_iterator i = found.begin(); i != found.end(); i++) {
+			const Triangle* t = it->index.getTriangle(*i);
+			const TriFit fit = t->getTarget();
+			const AffineTransform& trans = it->transforms[*i];
+			const Rectangle bounds = t->getBoundingBox();
+			const int xStart = max(left, (int)floor(bounds.getLeft() / xInc));
+			const int xEnd = min(left + w - 1, (int)ceil(bounds.getRight() / xInc));
+			const int yStart = max(top, (int)floor(bounds.getTop() / yInc));
+			const int yEnd = min(top + h - 1, (int)ceil(bounds.getBottom() / yInc));
+			for (int py = yStart; py <= yEnd; py++) {
+				for (int px = xStart; px <= xEnd; px++) {
+					const Point2D point(px * xInc, py * yInc);
+					if (!t->pointInside(point)) {
+						continue;
+					}
+					const Point2D source = trans.transform(point);
+					const size_t pixel = (size_t)(py - top) * w + (px - left);
+					for (unsigned char c = 0; c < components; c++) {
+						const Channel component = getComponent(it->channel, c);
+						buffer.add(pixel, c, getSourcePixel(level - 1, source, component, cursor) * fit.saturation[c] +
+						                     fit.brightness[c]);
+					}
+					buffer.hit(pixel);
+				}
+			}
+		}
+		buffer.normalize();
+		if (fixErrors) {
+			buffer.interpolateErrors();
+		}
+		buffer.writeTo(padded, it->channel);
+	}
+	gdImagePtr result = gdImageCreateTrueColor(tileWidth, tileHeight);
+	gdImageAlphaBlending(result, 0);
+	gdImageSaveAlpha(result, 1);
+	gdImageCopy(result, padded, 0, 0, tileLeft - left, tileTop - top, tileWidth, tileHeight);
+	gdFree(padded);
+	if (outputDebug()) {
+		output << "Rendered tile " << level << "/" << x << "/" << y << "." << endl;
+	}
+	return result;
+}
+
+// The pixel of a level nearest to point, the same way DoubleImage::valueAt()
+// picks it
+unsigned char TilePyramid::getSourcePixel(int level, const Point2D& point, Channel component, Cursor& cursor) {
+	const int px = doubleToInt(point.getX(), 0, getLevelWidth(level) - 1);
+	const int py = doubleToInt(point.getY(), 0, getLevelHeight(level) - 1);
+	const int tx = px / tileSize;
+	const int ty = py / tileSize;
+	if (tx != cursor.x || ty != cursor.y) {
+		cursor.x = tx;
+		cursor.y = ty;
+		cursor.tile = getTile(level, tx, ty);
+	}
+	return getPixel(cursor.tile, px - tx * tileSize, py - ty * tileSize, component, false);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TILEPYRAMID_H
+#define _TILEPYRAMID_H
+
+#include <vector>
+#include <map>
+#include <utility>
+#include "gd.h"
+
+#include "fractalimage.h"
+#include "triangleindex.h"
+#include "affinetransform.h"
+#include "imageutils.h"
+
+// A decoded fractal as a pyramid of square tiles for zooming into. Level 0
+// is a single tile holding an ordinary decode, and each level after it is
+// twice the size of the one before. A tile is rendered with one iteration
+// that reads its domains from the level above, which already holds all but
+// the finest detail, so it only costs about as much as its own pixels. The
+// triangles and their transforms are worked out once for every tile and
+// level, and rendered tiles are kept for the tiles below them to read from.
+class TilePyramid {
+private:
+	struct ChannelMapping {
+		Channel channel;
+		TriangleIndex index;
+		// The transform from each triangle of index to its domain
+		std::vector<AffineTransform> transforms;
+		ChannelMapping(const TriangleTree* tree);
+	};
+	// The tile last read from, since neighbouring pixels mostly read from
+	// the same one
+	struct Cursor {
+		int x;
+		int y;
+		gdImagePtr tile;
+		Cursor();
+	};
+	typedef std::map<std::pair<int, int>, gdImagePtr> Level;
+
+	FractalImage::ImageType type;
+	int tileSize;
+	int baseWidth;
+	int baseHeight;
+	bool fixErrors;
+	std::vector<ChannelMapping> channels;
+	std::vector<Level> levels;
+	std::vector<bool> complete;
+
+	gdImagePtr renderTile(int level, int x, int y);
+	unsigned char getSourcePixel(int level, const Point2D& point, Channel component, Cursor& cursor);
+	void addLevels(int level);
+public:
+	TilePyramid(const FractalImage& fractal, bool fixErrors);
+	~TilePyramid();
+	int getTileSize() const;
+	int getMaxLevel() const;
+	int getLevelWidth(int level) const;
+	int getLevelHeight(int level) const;
+	int getColumns(int level) const;
+	int getRows(int level) const;
+	gdImagePtr getTile(int level, int x, int y);
+	gdImagePtr exportTile(int level, int x, int y);
+	void renderLevel(int level, unsigned int threads = 1);
+	void dropLevel(int level);
+};
+
+#endif
@@ -29,6 +29,17 @@
 
 using namespace std;
 
+const unsigned char Triangle::SHORT_IDS;
+const unsigned char Triangle::LONG_IDS;
+
+static void serializeIndex(ostream& out, const Triangle* t, const map<const Triangle*, unsigned int>& indices) {
+	if (t == NULL) {
+		serializeSignedInt(out, Triangle::NO_INDEX);
+	} else {
+		serializeSignedInt(out, indices.find(t)->second);
+	}
+}
+
 Triangle::Triangle(const Point2D& point0, const Point2D& point1,
 		const Point2D& point2) :  nextSibling(NULL),prevSibling(NULL), parent(NULL), unresolvedDependencies(NULL), id(0), children(0) {
 	points.reserve(3);
@@ -37,12 +48,12 @@ Triangle::Triangle(const Point2D& point0, const Point2D& point1,
 	points.push_back(point2);
 }
 
-Triangle::Triangle(istream& in) : nextSibling(NULL), prevSibling(NULL), parent(NULL), children(0) {
+Triangle::Triangle(istream& in, unsigned char components, unsigned char idSize) : nextSibling(NULL), prevSibling(NULL), parent(NULL), children(0) {
 	unresolvedDependencies = new Dependencies;
-	id = unserializeUnsignedShort(in);
-	unresolvedDependencies->parent = unserializeUnsignedShort(in);
-	unresolvedDependencies->prevSibling = unserializeUnsignedShort(in);
-	unresolvedDependencies->nextSibling = unserializeUnsignedShort(in);
+	id = unserializeID(in, idSize);
+	unresolvedDependencies->parent = unserializeID(in, idSize);
+	unresolvedDependencies->prevSibling = unserializeID(in, idSize);
+	unresolvedDependencies->nextSibling = unserializeID(in, idSize);
 	points.reserve(3);
 	points.push_back(Point2D(in));
 	points.push_back(Point2D(in));
@@ -53,11 +64,11 @@ Triangle::Triangle(istream& in) : nextSibling(NULL), prevSibling(NULL), parent(N
 	if (numChildren != 0) {
 		unresolvedDependencies->children.reserve(numChildren);
 		for (char i = 0; i < numChildren; i++) {
-			unresolvedDependencies->children.push_back(unserializeUnsignedShort(in));
+			unresolvedDependencies->children.push_back(unserializeID(in, idSize));
 		}
-		unresolvedDependencies->target = 0xFFFF;
+		unresolvedDependencies->target = NO_INDEX;
 	} else {
-		target = TriFit(in, &(unresolvedDependencies->target));
+		target = TriFit(in, &(unresolvedDependencies->target), components, idSize);
 		unresolvedDependencies->children.resize(0);
 	}
 }
@@ -112,11 +123,11 @@ bool Triangle::isTerminal() const {
 	return this->children.empty();
 }
 
-unsigned short Triangle::getId() const {
+unsigned int Triangle::getId() const {
 	return this->id;
 }
 
-void Triangle::setId(unsigned short id) {
+void Triangle::setId(unsigned int id) {
 	this->id = id;
 }
 
@@ -290,57 +301,78 @@ Point2D Triangle::calcCenteroid() const {
 	return Point2D(x,y);
 }
 
-void Triangle::serialize(ostream& out) const {
-	serializeID(out);
-	if (parent != NULL) {
-		parent->serializeID(out);
-	} else {
-		serializeUnsignedShort(out, 0xFFFF);
-	}
-	if (prevSibling != NULL) {
-		prevSibling->serializeID(out);
-	} else {
-		serializeUnsignedShort(out, 0xFFFF);
-	}
-	if (nextSibling != NULL) {
-		nextSibling->serializeID(out);
-	} else {
-		serializeUnsignedShort(out, 0xFFFF);
-	}
+void Triangle::serialize(ostream& out, unsigned char components, unsigned char idSize) const {
+	serializeID(out, idSize);
+	serializeID(out, parent, idSize);
+	serializeID(out, prevSibling, idSize);
+	serializeID(out, nextSibling, idSize);
 	for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
 		it->serialize(out);
 	}
 	out.put((char)children.size());
 	if (!children.empty()) {
 		for (vector<Triangle*>::const_iterator it = children.begin(); it != children.end(); it++) {
-			(*it)->serializeID(out);
+			(*it)->serializeID(out, idSize);
 		}
 	} else {
-		target.serialize(out);
+		target.serialize(out, components, idSize);
+	}
+}
+
+void Triangle::serializeID(ostream& out, unsigned char idSize) const {
+	serializeID(out, this, idSize);
+}
+
+// NULL is written as all ones
+void Triangle::serializeID(ostream& out, const Triangle* t, unsigned char idSize) {
+	const unsigned int id = (t != NULL)?t->id:NO_INDEX;
+	if (idSize == SHORT_IDS) {
+		serializeUnsignedShort(out, id);
+	} else {
+		serializeSignedInt(out, id);
+	}
+}
+
+unsigned int Triangle::unserializeID(istream& in, unsigned char idSize) {
+	if (idSize == SHORT_IDS) {
+		const unsigned short id = unserializeUnsignedShort(in);
+		return (id == 0xFFFF)?NO_INDEX:id;
 	}
+	return unserializeSignedInt(in);
+}
+
+size_t Triangle::getSerializedSize(unsigned char components, unsigned char idSize) const {
+	return getSerializedSize(children.size(), components, idSize);
 }
 
-void Triangle::serializeID(ostream& out) const {
-	serializeUnsignedShort(out, id);
+// Must be kept in sync with serialize()
+size_t Triangle::getSerializedSize(size_t numChildren, unsigned char components, unsigned char idSize) {
+	size_t size = 4 * idSize + 3 * 2 * 4 + 1;
+	if (numChildren != 0) {
+		size += numChildren * idSize;
+	} else {
+		size += TriFit::getSerializedSize(components, idSize);
+	}
+	return size;
 }
 
 void Triangle::resolveDependencies(const vector<Triangle*>& tris) {
-	if (unresolvedDependencies->parent != 0xFFFF) {
+	if (unresolvedDependencies->parent != NO_INDEX) {
 		parent = tris[unresolvedDependencies->parent];
 	} else {
 		parent = NULL;
 	}
-	if (unresolvedDependencies->nextSibling != 0xFFFF) {
+	if (unresolvedDependencies->nextSibling != NO_INDEX) {
 		nextSibling = tris[unresolvedDependencies->nextSibling];
 	} else {
 		nextSibling = NULL;
 	}
-	if (unresolvedDependencies->prevSibling != 0xFFFF) {
+	if (unresolvedDependencies->prevSibling != NO_INDEX) {
 		prevSibling = tris[unresolvedDependencies->prevSibling];
 	} else {
 		prevSibling = NULL;
 	}
-	if (unresolvedDependencies->target != 0xFFFF) {
+	if (unresolvedDependencies->target != NO_INDEX) {
 		target.best = tris[unresolvedDependencies->target];
 	} else {
 		target.best = NULL;
@@ -354,3 +386,49 @@ void Triangle::resolveDependencies(const vector<Triangle*>& tris) {
 	delete unresolvedDependencies;
 	unresolvedDependencies = NULL;
 }
+
+// Unlike serialize() this keeps the full precision of the points and fit and
+// refers to other triangles by their index in the tree, as unassigned
+// triangles do not have ids yet.
+void Triangle::saveState(ostream& out, const map<const Triangle*, unsigned int>& indices) const {
+	serializeSignedInt(out, id);
+	serializeIndex(out, parent, indices);
+	serializeIndex(out, prevSibling, indices);
+	serializeIndex(out, nextSibling, indices);
+	for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
+		serializeDouble(out, it->getX());
+		serializeDouble(out, it->getY());
+	}
+	out.put((char)children.size());
+	for (vector<Triangle*>::const_iterator it = children.begin(); it != children.end(); it++) {
+		serializeIndex(out, *it, indices);
+	}
+	target.saveState(out);
+	serializeIndex(out, target.best, indices);
+}
+
+Triangle* Triangle::loadState(istream& in) {
+	unsigned int id = unserializeSignedInt(in);
+	Dependencies* deps = new Dependencies;
+	deps->parent = unserializeSignedInt(in);
+	deps->prevSibling = unserializeSignedInt(in);
+	deps->nextSibling = unserializeSignedInt(in);
+	double coords[6];
+	for (int i = 0; i < 6; i++) {
+		coords[i] = unserializeDouble(in);
+	}
+	char numChildren = 0;
+	in.get(numChildren);
+	deps->children.reserve(numChildren);
+	for (char i = 0; i < numChildren; i++) {
+		deps->children.push_back(unserializeSignedInt(in));
+	}
+
+	Triangle* t = new Triangle(Point2D(coords[0], coords[1]), Point2D(coords[2], coords[3]),
+	                           Point2D(coords[4], coords[5]));
+	t->id = id;
+	t->target.loadState(in);
+	deps->target = unserializeSignedInt(in);
+	t->unresolvedDependencies = deps;
+	return t;
+}
@@ -23,6 +23,7 @@
 class Triangle;
 
 #include <vector>
+#include <map>
 #include <cstddef>
 #include <string>
 #include <ostream>
@@ -35,12 +36,13 @@ class Triangle;
 
 class Triangle {
 private:
+	// Indices into the vector passed to resolveDependencies()
 	struct Dependencies {
-		unsigned short parent;
-		unsigned short nextSibling;
-		unsigned short prevSibling;
-		unsigned short target;
-		std::vector<unsigned short> children;
+		unsigned int parent;
+		unsigned int nextSibling;
+		unsigned int prevSibling;
+		unsigned int target;
+		std::vector<unsigned int> children;
 	};
 	Triangle* nextSibling;
 	Triangle* prevSibling;
@@ -48,7 +50,7 @@ private:
 
 	Dependencies* unresolvedDependencies;
 
-	unsigned short id;
+	unsigned int id;
 
 	std::vector<Point2D> points;
 
@@ -59,9 +61,14 @@ private:
 	void assignPrevChildSibling(Triangle* prev, Triangle* triangle);
 	void assignNextChildSibling(Triangle* next, Triangle* triangle);
 public:
+	static const unsigned int NO_INDEX = 0xFFFFFFFF;
+	// Ids are written as shorts unless a tree has more triangles than fit
+	static const unsigned char SHORT_IDS = 2;
+	static const unsigned char LONG_IDS = 4;
+
 	Triangle(const Point2D& point0, const Point2D& point1,
 			const Point2D& point2);
-	Triangle(std::istream& in);
+	Triangle(std::istream& in, unsigned char components = 1, unsigned char idSize = SHORT_IDS);
 	~Triangle();
 	//Getters and Setters
 	void setNextSibling(Triangle* next);
@@ -75,8 +82,8 @@ public:
 	TriFit getTarget() const;
 	const std::vector<Point2D>& getPoints() const;
 	const std::vector<Triangle*>& getChildren() const;
-	unsigned short getId() const;
-	void setId(unsigned short id);
+	unsigned int getId() const;
+	void setId(unsigned int id);
 
 	void subdivide(double r01, double r02, double r12);
 	void subdivideBarycentric();
@@ -89,9 +96,15 @@ public:
 	Point2D calcCenteroid() const;
 
 	std::string str() const;
-	void serialize(std::ostream& out) const;
-	void serializeID(std::ostream& out) const;
+	void serialize(std::ostream& out, unsigned char components = 1, unsigned char idSize = SHORT_IDS) const;
+	void serializeID(std::ostream& out, unsigned char idSize = SHORT_IDS) const;
+	std::size_t getSerializedSize(unsigned char components = 1, unsigned char idSize = SHORT_IDS) const;
+	static std::size_t getSerializedSize(std::size_t numChildren, unsigned char components, unsigned char idSize = SHORT_IDS);
+	static void serializeID(std::ostream& out, const Triangle* t, unsigned char idSize);
+	static unsigned int unserializeID(std::istream& in, unsigned char idSize);
 	void resolveDependencies(const std::vector<Triangle*>& tris);
+	void saveState(std::ostream& out, const std::map<const Triangle*, unsigned int>& indices) const;
+	static Triangle* loadState(std::istream& in);
 };
 
 #endif
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "triangleindex.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+TriangleIndex::TriangleIndex(const vector<Triangle*>& triangles) : triangles(triangles),
+	size(max(1, (int)sqrt((double)triangles.size()))) {
+	bounds.reserve(triangles.size());
+	for (vector<Triangle*>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+		bounds.push_back((*it)->getBoundingBox());
+	}
+
+	// Count the entries of every cell first so they can go in one array
+	cellStarts.assign((size_t)size * size + 1, 0);
+	for (size_t i = 0; i < bounds.size(); i++) {
+		int left, top, right, bottom;
+		getCells(bounds[i], left, top, right, bottom);
+		for (int y = top; y <= bottom; y++) {
+			for (int x = left; x <= right; x++) {
+				cellStarts[y * size + x + 1]++;
+			}
+		}
+	}
+	for (size_t i = 0; i < (size_t)size * size; i++) {
+		cellStarts[i + 1] += cellStarts[i];
+	}
+	cells.resize(cellStarts.back());
+	vector<size_t> next(cellStarts.begin(), cellStarts.end() - 1);
+	for (size_t i = 0; i < bounds.size(); i++) {
+		int left, top, right, bottom;
+		getCells(bounds[i], left, top, right, bottom);
+		for (int y = top; y <= bottom; y++) {
+			for (int x = left; x <= right; x++) {
+				cells[next[y * size + x]++] = i;
+			}
+		}
+	}
+}
+
+// The range of cells an area touches, clamped to the grid
+void TriangleIndex::getCells(const Rectangle& area, int& left, int& top, int& right, int& bottom) const {
+	left = min(max((int)floor(area.getLeft() * size), 0), size - 1);
+	top = min(max((int)floor(area.getTop() * size), 0), size - 1);
+	right = min(max((int)floor(area.getRight() * size), 0), size - 1);
+	bottom = min(max((int)floor(area.getBottom() * size), 0), size - 1);
+}
+
+size_t TriangleIndex::getSize() const {
+	return triangles.size();
+}
+
+Triangle* TriangleIndex::getTriangle(size_t i) const {
+	return triangles[i];
+}
+
+// The indices of the triangles whose bounding boxes overlap area, in the
+// order the triangles were given in
+vector<size_t> TriangleIndex::find(const Rectangle& area) const {
+	vector<size_t> result;
+	int left, top, right, bottom;
+	getCells(area, left, top, right, bottom);
+	for (int y = top; y <= bottom; y++) {
+		for (int x = left; x <= right; x++) {
+			const size_t cell = y * size + x;
+			for (size_t j = cellStarts[cell]; j < cellStarts[cell + 1]; j++) {
+				if (bounds[cells[j]].intersects(area)) {
+					result.push_back(cells[j]);
+				}
+			}
+		}
+	}
+	sort(result.begin(), result.end());
+	result.erase(unique(result.begin(), result.end()), result.end());
+	return result;
+}
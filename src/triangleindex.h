@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Allan Wirth <allanlw@gmail.com>
+ *
+ * This file is part of Fractal Image Compressor.
+ *
+ * Fractal Image Compressor is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Fractal Image Compressor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Fractal Image Compressor.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TRIANGLEINDEX_H
+#define _TRIANGLEINDEX_H
+
+#include <vector>
+#include <cstddef>
+
+#include "triangle.h"
+#include "rectangle.h"
+
+// A uniform grid over the unit square that finds the triangles whose
+// bounding boxes overlap an area without looking at all of them. Each
+// triangle is listed in every cell its bounding box touches, and the grid
+// has about one cell per triangle.
+class TriangleIndex {
+private:
+	std::vector<Triangle*> triangles;
+	std::vector<Rectangle> bounds;
+	int size;
+	// The triangles of cell i are cells[cellStarts[i]] up to
+	// cells[cellStarts[i + 1]]
+	std::vector<std::size_t> cellStarts;
+	std::vector<std::size_t> cells;
+
+	void getCells(const Rectangle& area, int& left, int& top, int& right, int& bottom) const;
+public:
+	TriangleIndex(const std::vector<Triangle*>& triangles);
+	std::size_t getSize() const;
+	Triangle* getTriangle(std::size_t i) const;
+	std::vector<std::size_t> find(const Rectangle& area) const;
+};
+
+#endif
@@ -22,6 +22,10 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
 #include "gd.h"
 #include <stdexcept>
 
@@ -29,10 +33,24 @@
 #include "ioutils.h"
 #include "imageutils.h"
 #include "output.h"
+#include "triangleindex.h"
 
 using namespace std;
 
-TriangleTree::TriangleTree(DoubleImage& image, Channel channel) : channel(channel), image(image), lastId(0), sMethod(DEFAULT_SUBDIVISION_METHOD) {
+TriangleTree::QueuedTriangle::QueuedTriangle(double priority, Triangle* triangle) : priority(priority), triangle(triangle) {
+}
+
+// Ties go to the lower id so that the order is deterministic
+bool TriangleTree::QueuedTriangle::operator<(const QueuedTriangle& other) const {
+	if (priority != other.priority) {
+		return priority < other.priority;
+	}
+	return triangle->getId() > other.triangle->getId();
+}
+
+TriangleTree::TriangleTree(DoubleImage& image, Channel channel) : channel(channel), image(image), lastId(0),
+	sMethod(DEFAULT_SUBDIVISION_METHOD), sOrder(DEFAULT_SUBDIVISION_ORDER), maxTriangles(0), maxBytes(0), fitCache(NULL), hasRegion(false),
+	hasDetailLimit(false) {
 	std::vector<Point2D> corners = image.getCorners();
 	Triangle* head = new Triangle(corners[0], corners[1], corners[2]);
 	head->setNextSibling(new Triangle(corners[0], corners[3], corners[2]));
@@ -40,19 +58,27 @@ TriangleTree::TriangleTree(DoubleImage& image, Channel channel) : channel(channe
 	unassigned.push_back(head->getNextSibling());
 	allTriangles.push_back(head);
 	allTriangles.push_back(head->getNextSibling());
+	resetSerializedSize();
+	addSerializedSize(head);
+	addSerializedSize(head->getNextSibling());
 }
 
-TriangleTree::TriangleTree(DoubleImage& image, istream& in, Channel channel) : channel(channel), image(image), lastId(0), sMethod(DEFAULT_SUBDIVISION_METHOD) {
+TriangleTree::TriangleTree(DoubleImage& image, istream& in, Channel channel) : channel(channel), image(image), lastId(0),
+	sMethod(DEFAULT_SUBDIVISION_METHOD), sOrder(DEFAULT_SUBDIVISION_ORDER), maxTriangles(0), maxBytes(0), fitCache(NULL), hasRegion(false),
+	hasDetailLimit(false) {
 	this->unserialize(in);
 }
 
 TriangleTree::~TriangleTree() {
+	clearDetailLimit();
 	for (std::vector<Triangle*>::iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
 		delete *it;
 	}
 }
 
-TriangleTree::TriangleTree(const TriangleTree& tree) : image(tree.image), lastId(0), sMethod(tree.sMethod) {
+TriangleTree::TriangleTree(const TriangleTree& tree) : channel(tree.channel), image(tree.image), lastId(0), sMethod(tree.sMethod),
+	sOrder(tree.sOrder), maxTriangles(tree.maxTriangles), maxBytes(tree.maxBytes), fitCache(tree.fitCache),
+	hasRegion(false), hasDetailLimit(false) {
 	std::stringstream serial(ios_base::out|ios_base::in|ios_base::binary);
 
 	tree.serialize(serial);
@@ -84,7 +110,96 @@ void TriangleTree::setSubdivisionMethod(TriangleTree::SubdivisionMethod sMethod)
 	this->sMethod = sMethod;
 }
 
+TriangleTree::SubdivisionOrder TriangleTree::getSubdivisionOrder() const {
+	return sOrder;
+}
+
+void TriangleTree::setSubdivisionOrder(TriangleTree::SubdivisionOrder sOrder) {
+	this->sOrder = sOrder;
+}
+
+size_t TriangleTree::getMaxTriangles() const {
+	return maxTriangles;
+}
+
+void TriangleTree::setMaxTriangles(size_t maxTriangles) {
+	this->maxTriangles = maxTriangles;
+}
+
+size_t TriangleTree::getMaxBytes() const {
+	return maxBytes;
+}
+
+void TriangleTree::setMaxBytes(size_t maxBytes) {
+	this->maxBytes = maxBytes;
+}
+
+size_t TriangleTree::getSerializedSize() const {
+	return getSerializedSize(getIdSize());
+}
+
+size_t TriangleTree::getSerializedSize(unsigned char idSize) const {
+	return (idSize == Triangle::SHORT_IDS)?serializedSize:longSerializedSize;
+}
+
+// Short ids are used whenever every id and the null id (0xFFFF) still fit
+unsigned char TriangleTree::getIdSize(size_t numTriangles) {
+	return (numTriangles <= 0xFFFF)?Triangle::SHORT_IDS:Triangle::LONG_IDS;
+}
+
+unsigned char TriangleTree::getIdSize() const {
+	return getIdSize(allTriangles.size());
+}
+
+void TriangleTree::addSerializedSize(const Triangle* t) {
+	const unsigned char components = getNumComponents(channel);
+	serializedSize += t->getSerializedSize(components, Triangle::SHORT_IDS);
+	longSerializedSize += t->getSerializedSize(components, Triangle::LONG_IDS);
+}
+
+void TriangleTree::removeSerializedSize(const Triangle* t) {
+	const unsigned char components = getNumComponents(channel);
+	serializedSize -= t->getSerializedSize(components, Triangle::SHORT_IDS);
+	longSerializedSize -= t->getSerializedSize(components, Triangle::LONG_IDS);
+}
+
+// Just the "TREE"/"TRE4" magic and the number of ids
+void TriangleTree::resetSerializedSize() {
+	serializedSize = 4 + Triangle::SHORT_IDS;
+	longSerializedSize = 4 + Triangle::LONG_IDS;
+}
+
+FitCache* TriangleTree::getFitCache() const {
+	return fitCache;
+}
+
+void TriangleTree::setFitCache(FitCache* fitCache) {
+	this->fitCache = fitCache;
+}
+
+TriFit TriangleTree::findBestMatch(const Triangle* t, const list<Triangle*>& above) {
+	TriFit best;
+	if (fitCache != NULL && fitCache->lookup(t, channel, above, best)) {
+		return best;
+	}
+	best = image.getBestMatch(t, above.begin(), above.end(), channel);
+	if (fitCache != NULL) {
+		fitCache->store(t, channel, best);
+	}
+	return best;
+}
+
 Triangle* TriangleTree::assignOne(double cutoff) {
+	switch (sOrder) {
+	default:
+	case O_BREADTHFIRST:
+		return assignBreadthFirst(cutoff);
+	case O_BESTFIRST:
+		return assignBestFirst(cutoff);
+	}
+}
+
+Triangle* TriangleTree::assignBreadthFirst(double cutoff) {
 	if (unassigned.empty()) {
 		return NULL;
 	}
@@ -111,12 +226,12 @@ Triangle* TriangleTree::assignOne(double cutoff) {
 		subdivide(next);
 		return next;
 	} else {
-		TriFit best = image.getBestMatch(next, above.begin(), above.end(), channel);
+		TriFit best = findBestMatch(next, above);
 		if (outputDebug()) {
 			output << " - Best Error: " << best.error << endl;
 			output << " - # points inside: " << image.getPointsInside(next).size() << endl;
 		}
-		if (allTriangles.size() == MAX_NUM_TRIANGLES || ((best.error < cutoff*cutoff || image.getPointsInside(next).size() < MAX_SUBDIVIDE_SIZE) && best.error >= 0)) {
+		if (allTriangles.size() + 4 > MAX_NUM_TRIANGLES || isGoodEnough(next, best, cutoff)) {
 			next->setTarget(best);
 		} else {
 			subdivide(next);
@@ -125,7 +240,179 @@ Triangle* TriangleTree::assignOne(double cutoff) {
 	return next;
 }
 
+// Newly created triangles are fitted as soon as they are created so that the
+// queue can be keyed on their error. Only once every pending triangle has a
+// fit is the worst one (by error weighted by area) subdivided.
+Triangle* TriangleTree::assignBestFirst(double cutoff) {
+	if (!unassigned.empty()) {
+		Triangle* next = unassigned.front();
+		unassigned.pop_front();
+		next->setId(lastId++);
+
+		if (outputDebug()) {
+			output << "Fitting Triangle #" << next->getId() << "..." << endl;
+		}
+
+		list<Triangle*> above(0);
+		insert_iterator<list<Triangle*> > it(above, above.begin());
+		getAllAbove(next, it);
+
+		TriFit best;
+		if (!above.empty()) {
+			best = findBestMatch(next, above);
+			if (outputDebug()) {
+				output << " - Best Error: " << best.error << endl;
+			}
+		}
+		if (best.error >= 0) {
+			next->setTarget(best);
+			if (best.error >= cutoff*cutoff && image.getPointsInside(next).size() >= MAX_SUBDIVIDE_SIZE) {
+				worst.push(QueuedTriangle(best.error * next->getArea(), next));
+			}
+		} else {
+			// Without a usable domain the triangle must be subdivided
+			worst.push(QueuedTriangle(HUGE_VAL, next));
+		}
+		return next;
+	}
+
+	if (worst.empty()) {
+		return NULL;
+	}
+
+	Triangle* next = worst.top().triangle;
+	if (next->getTarget().error >= 0 && !withinBudget(next)) {
+		if (outputVerbose()) {
+			output << "Budget reached with " << allTriangles.size() << " triangles (";
+			output << getSerializedSize() << " bytes)." << endl;
+		}
+		worst = priority_queue<QueuedTriangle>();
+		return NULL;
+	}
+	worst.pop();
+
+	if (outputDebug()) {
+		output << "Subdividing Triangle #" << next->getId() << "..." << endl;
+	}
+	subdivide(next);
+	return next;
+}
+
+bool TriangleTree::isGoodEnough(const Triangle* t, const TriFit& fit, double cutoff) {
+	return (fit.error < cutoff*cutoff || image.getPointsInside(t).size() < MAX_SUBDIVIDE_SIZE) && fit.error >= 0;
+}
+
+// Takes over the subdivision and fits of previous, which is the same channel
+// of the previous frame. Every fit is redone against the current image with
+// the domain it had before and only those that are no longer good enough are
+// searched again. If that does not help either the triangle is subdivided
+// (or queued for it) and assignOne() takes it from there as usual.
+// The subdivision is never undone, so if the old fits miss the current image
+// by more than cutoff (rms over the image) nothing is done and false is
+// returned: the frame is better encoded on its own.
+bool TriangleTree::inherit(const TriangleTree& previous, double cutoff) {
+	// Going through the checkpoint state keeps the points at full precision,
+	// so unchanged areas refit to exactly what they were
+	std::stringstream state(ios_base::out|ios_base::in|ios_base::binary);
+	previous.saveState(state);
+	loadState(state);
+
+	const vector<Triangle*>::size_type count = allTriangles.size();
+	vector<double> errors(count, -1);
+	double totalError = 0;
+	double totalArea = 0;
+	for (vector<Triangle*>::size_type i = 0; i < count; i++) {
+		const Triangle* t = allTriangles[i];
+		if (t->isTerminal() && t->getTarget().best != NULL) {
+			errors[i] = image.getFitError(t, t->getTarget(), channel);
+			if (errors[i] >= 0) {
+				totalError += errors[i] * t->getArea();
+				totalArea += t->getArea();
+			}
+		}
+	}
+	const double inheritedError = (totalArea > 0)?sqrt(totalError / totalArea):0;
+	if (inheritedError > cutoff) {
+		if (outputVerbose()) {
+			output << "Inherited fits are off by " << inheritedError << " (rms), over the cutoff." << endl;
+		}
+		return false;
+	}
+
+	size_t kept = 0;
+	size_t refit = 0;
+	size_t searched = 0;
+	for (vector<Triangle*>::size_type i = 0; i < count; i++) {
+		Triangle* t = allTriangles[i];
+		if (!t->isTerminal()) {
+			continue;
+		}
+		TriFit fit = t->getTarget();
+		if (fit.best != NULL) {
+			// Fits that still hold, or at least got no worse, are left exactly
+			// as they were so that the triangle does not show up in the delta
+			const double error = errors[i];
+			if (error >= 0 && (error < cutoff*cutoff || error <= fit.error || doublesEqual(error, fit.error))) {
+				kept++;
+				continue;
+			}
+			fit = image.getOptimalFit(t, fit.best, channel);
+		}
+		if (!isGoodEnough(t, fit, cutoff)) {
+			list<Triangle*> above(0);
+			insert_iterator<list<Triangle*> > it(above, above.begin());
+			getAllAbove(t, it);
+			if (!above.empty()) {
+				TriFit best = findBestMatch(t, above);
+				if (best.error >= 0 && (fit.error < 0 || best.error < fit.error)) {
+					fit = best;
+				}
+			}
+			searched++;
+		} else {
+			refit++;
+		}
+		t->setTarget(fit);
+		if (isGoodEnough(t, fit, cutoff)) {
+			continue;
+		}
+		if (sOrder == O_BESTFIRST) {
+			worst.push(QueuedTriangle((fit.error >= 0)?fit.error * t->getArea():HUGE_VAL, t));
+		} else if (withinBudget(t)) {
+			subdivide(t);
+		}
+	}
+	if (outputVerbose()) {
+		output << "Inherited " << count << " triangles, " << kept << " kept, " << refit << " refit, ";
+		output << searched << " searched again (fits off by " << inheritedError << " rms)." << endl;
+	}
+	return true;
+}
+
+bool TriangleTree::withinBudget(const Triangle* t) const {
+	const size_t numChildren = (sMethod == M_QUAD)?4:3;
+	const unsigned char components = getNumComponents(channel);
+	size_t limit = MAX_NUM_TRIANGLES;
+	if (maxTriangles != 0 && maxTriangles < limit) {
+		limit = maxTriangles;
+	}
+	if (allTriangles.size() + numChildren > limit) {
+		return false;
+	}
+	if (maxBytes != 0) {
+		const unsigned char idSize = getIdSize(allTriangles.size() + numChildren);
+		const size_t newSize = getSerializedSize(idSize) - t->getSerializedSize(components, idSize) +
+		                       Triangle::getSerializedSize(numChildren, components, idSize) +
+		                       numChildren * Triangle::getSerializedSize(0, components, idSize);
+		if (newSize > maxBytes) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void TriangleTree::subdivide(Triangle* t) {
+	removeSerializedSize(t);
 	switch(sMethod) {
 	case M_QUAD: {
 		if (!image.hasEdges()) {
@@ -146,9 +433,11 @@ void TriangleTree::subdivide(Triangle* t) {
 		t->subdivideBarycentric();
 		break;
 	}
+	addSerializedSize(t);
 	for(vector<Triangle*>::const_iterator it = t->getChildren().begin(); it != t->getChildren().end(); it++) {
 		unassigned.push_back(*it);
 		allTriangles.push_back(*it);
+		addSerializedSize(*it);
 	}
 }
 
@@ -191,69 +480,360 @@ void TriangleTree::getAllPrevSiblings(Triangle* t, insert_iterator<list<Triangle
 	}
 }
 
-unsigned short TriangleTree::getLastId() {
+unsigned int TriangleTree::getLastId() {
 	return lastId;
 }
 
-void TriangleTree::serializeChildren(ostream& out, const Triangle* t) {
-	t->serialize(out);
+void TriangleTree::serializeChildren(ostream& out, const Triangle* t, unsigned char components, unsigned char idSize) {
+	t->serialize(out, components, idSize);
 	if (!t->isTerminal()) {
 		const vector<Triangle*>& children = t->getChildren();
 		for (vector<Triangle*>::const_iterator it=children.begin(); it != children.end(); it++) {
-			serializeChildren(out, *it);
+			serializeChildren(out, *it, components, idSize);
 		}
 	}
 }
 
-void TriangleTree::serializeTree(ostream& out, const Triangle* t) {
-	serializeChildren(out, t);
+void TriangleTree::serializeTree(ostream& out, const Triangle* t, unsigned char components, unsigned char idSize) {
+	serializeChildren(out, t, components, idSize);
 	if (t->getNextSibling() != NULL) {
-		serializeTree(out, t->getNextSibling());
+		serializeTree(out, t->getNextSibling(), components, idSize);
 	}
 }
 
+// Trees small enough for 16 bit ids keep the original "TREE" layout, larger
+// ones are written as "TRE4" with every id widened to 32 bits.
 void TriangleTree::serialize(ostream& out) const {
-	out << "TREE";
-	serializeUnsignedShort(out, lastId);
-	serializeTree(out, allTriangles.front());
+	const unsigned char idSize = getIdSize();
+	if (idSize == Triangle::SHORT_IDS) {
+		out << "TREE";
+		serializeUnsignedShort(out, lastId);
+	} else {
+		out << "TRE4";
+		serializeSignedInt(out, lastId);
+	}
+	serializeTree(out, allTriangles.front(), getNumComponents(channel), idSize);
 }
 
 void TriangleTree::unserialize(istream& in) {
 	char magic[5];
 	in.read(magic, 4);
 	magic[4] = '\0';
-	if (!(string("TREE") == magic)) {
+	unsigned char idSize;
+	unsigned int numIds;
+	if (string("TREE") == magic) {
+		idSize = Triangle::SHORT_IDS;
+		numIds = unserializeUnsignedShort(in);
+	} else if (string("TRE4") == magic) {
+		idSize = Triangle::LONG_IDS;
+		numIds = unserializeSignedInt(in);
+	} else {
 		throw logic_error("NOT VALID FILE");
 	}
-	unsigned short numIds = unserializeUnsignedShort(in);
 	allTriangles.resize(numIds, NULL);
+	lastId = numIds;
 
 	for (std::vector<Triangle*>::size_type i = 0; i < numIds; i++) {
-		Triangle* temp = new Triangle(in);
+		Triangle* temp = new Triangle(in, getNumComponents(channel), idSize);
+		if (temp->getId() >= numIds) {
+			delete temp;
+			throw logic_error("NOT VALID FILE");
+		}
 		allTriangles[temp->getId()] = temp;
 	}
 
+	resetSerializedSize();
 	for (std::vector<Triangle*>::size_type i = 0; i < numIds; i++) {
 		allTriangles[i]->resolveDependencies(allTriangles);
+		addSerializedSize(allTriangles[i]);
 	}
 }
 
-void TriangleTree::renderTo(gdImagePtr image, bool fixErrors) {
-	if (outputVerbose()) {
-		output << "Rendering channel " << channelToString(channel) << "..." << endl;
+// The serialized form of each triangle, indexed by id
+void TriangleTree::getRecords(vector<string>& records) const {
+	const unsigned char components = getNumComponents(channel);
+	const unsigned char idSize = getIdSize();
+	records.resize(allTriangles.size());
+	for (vector<Triangle*>::const_iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
+		ostringstream record(ios_base::out|ios_base::binary);
+		(*it)->serialize(record, components, idSize);
+		records[(*it)->getId()] = record.str();
+	}
+}
+
+// Unlike serialize() this captures everything assignOne() needs to carry on
+// exactly where it left off, so the options are left to the caller.
+void TriangleTree::saveState(ostream& out) const {
+	map<const Triangle*, unsigned int> indices;
+	for (vector<Triangle*>::size_type i = 0; i < allTriangles.size(); i++) {
+		indices[allTriangles[i]] = i;
 	}
+
+	out << "TSTA";
+	serializeSignedInt(out, lastId);
+	serializeSignedInt(out, allTriangles.size());
 	for (vector<Triangle*>::const_iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
-		if (!(*it)->isTerminal()) {
+		(*it)->saveState(out, indices);
+	}
+
+	serializeSignedInt(out, unassigned.size());
+	for (deque<Triangle*>::const_iterator it = unassigned.begin(); it != unassigned.end(); it++) {
+		serializeSignedInt(out, indices[*it]);
+	}
+
+	priority_queue<QueuedTriangle> queue(worst);
+	serializeSignedInt(out, queue.size());
+	while (!queue.empty()) {
+		serializeDouble(out, queue.top().priority);
+		serializeSignedInt(out, indices[queue.top().triangle]);
+		queue.pop();
+	}
+}
+
+void TriangleTree::loadState(istream& in) {
+	char magic[5];
+	in.read(magic, 4);
+	magic[4] = '\0';
+	if (!(string("TSTA") == magic)) {
+		throw logic_error("NOT VALID CHECKPOINT");
+	}
+
+	for (vector<Triangle*>::iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
+		delete *it;
+	}
+	unassigned.clear();
+	worst = priority_queue<QueuedTriangle>();
+
+	lastId = unserializeSignedInt(in);
+	const unsigned int numTriangles = unserializeSignedInt(in);
+	allTriangles.resize(numTriangles);
+	for (unsigned int i = 0; i < numTriangles; i++) {
+		allTriangles[i] = Triangle::loadState(in);
+	}
+
+	resetSerializedSize();
+	for (unsigned int i = 0; i < numTriangles; i++) {
+		allTriangles[i]->resolveDependencies(allTriangles);
+		addSerializedSize(allTriangles[i]);
+	}
+
+	const unsigned int numUnassigned = unserializeSignedInt(in);
+	for (unsigned int i = 0; i < numUnassigned; i++) {
+		unassigned.push_back(allTriangles[unserializeSignedInt(in)]);
+	}
+
+	const unsigned int numWorst = unserializeSignedInt(in);
+	for (unsigned int i = 0; i < numWorst; i++) {
+		const double priority = unserializeDouble(in);
+		worst.push(QueuedTriangle(priority, allTriangles[unserializeSignedInt(in)]));
+	}
+
+	if (!in.good()) {
+		throw logic_error("NOT VALID CHECKPOINT");
+	}
+}
+
+// In the order they appear in the tree
+vector<Triangle*> TriangleTree::getTerminals() const {
+	vector<Triangle*> result;
+	for (vector<Triangle*>::const_iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
+		if ((*it)->isTerminal()) {
+			result.push_back(*it);
+		}
+	}
+	return result;
+}
+
+// Cuts the tree for a quicker, blurrier decode: triangles maxDepth below the
+// top (if it is not negative) and triangles with children smaller than
+// minArea (as a fraction of the image) are decoded as if they were terminal.
+// The file has no fits for the ones that are not, so they are fitted to the
+// current image the same way the encoder fits a triangle, which should be a
+// decode of the whole tree with enough pixels for the smallest of them (see
+// getSmallestCut()).
+void TriangleTree::setDetailLimit(int maxDepth, double minArea) {
+	clearDetailLimit();
+	set<const Triangle*> cut;
+	for (Triangle* t = allTriangles.front(); t != NULL; t = t->getNextSibling()) {
+		findCut(t, 0, maxDepth, minArea, cut);
+	}
+
+	for (vector<Triangle*>::const_iterator it = allTriangles.begin(); it != allTriangles.end(); it++) {
+		if (cut.find(*it) == cut.end()) {
 			continue;
 		}
-		this->image.mapPoints(*it, (*it)->getTarget(), image, channel);
+		detailTriangles.push_back(*it);
+		if ((*it)->isTerminal()) {
+			continue;
+		}
+		list<Triangle*> above(0);
+		insert_iterator<list<Triangle*> > inserter(above, above.begin());
+		getAllAbove(*it, inserter);
+		getNearest(*it, above, LOD_SEARCH_SIZE);
+		TriFit fit = image.getBestMatch(*it, above.begin(), above.end(), channel);
+		if (fit.best == NULL) {
+			fit = getFlatFit(*it);
+		}
+		(*it)->setTarget(fit);
+	}
+	hasDetailLimit = true;
+	if (outputVerbose()) {
+		output << "Channel " << channelToString(channel) << " is cut at " << detailTriangles.size() << " triangles." << endl;
+	}
+}
+
+// Keeps only the count triangles of candidates closest to t, so that
+// setDetailLimit() searches a fixed number of domains for each triangle
+// rather than every one above it
+void TriangleTree::getNearest(const Triangle* t, list<Triangle*>& candidates, size_t count) {
+	if (candidates.size() <= count) {
+		return;
+	}
+	const Point2D center = t->calcCenteroid();
+	vector<pair<double, Triangle*> > byDistance;
+	byDistance.reserve(candidates.size());
+	for (list<Triangle*>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+		if ((*it)->getArea() >= t->getArea() * MIN_SEARCH_RATIO) {
+			byDistance.push_back(make_pair(center.distanceSquared((*it)->calcCenteroid()), *it));
+		}
+	}
+	const size_t kept = min(count, byDistance.size());
+	partial_sort(byDistance.begin(), byDistance.begin() + kept, byDistance.end());
+	candidates.clear();
+	for (size_t i = 0; i < kept; i++) {
+		candidates.push_back(byDistance[i].second);
+	}
+}
+
+// The area of the smallest triangle that setDetailLimit() would have to fit,
+// or HUGE_VAL if the cut is made up of terminal triangles only
+double TriangleTree::getSmallestCut(int maxDepth, double minArea) const {
+	set<const Triangle*> cut;
+	for (Triangle* t = allTriangles.front(); t != NULL; t = t->getNextSibling()) {
+		findCut(t, 0, maxDepth, minArea, cut);
+	}
+	double smallest = HUGE_VAL;
+	for (set<const Triangle*>::const_iterator it = cut.begin(); it != cut.end(); it++) {
+		if (!(*it)->isTerminal()) {
+			smallest = min(smallest, (*it)->getArea());
+		}
+	}
+	return smallest;
+}
+
+// The mean of the triangle, for those at the top of the tree which have
+// nothing larger to be mapped from
+TriFit TriangleTree::getFlatFit(Triangle* t) {
+	TriFit fit(0, 0, 0, TriFit::P012, t);
+	const vector<Point2D>& points = image.getPointsInside(t);
+	const unsigned char components = getNumComponents(channel);
+	for (unsigned char c = 0; c < components; c++) {
+		double total = 0;
+		for (vector<Point2D>::const_iterator it = points.begin(); it != points.end(); it++) {
+			total += image.valueAt(*it, getComponent(channel, c));
+		}
+		fit.brightness[c] = points.empty()?0:total / points.size();
+	}
+	return fit;
+}
+
+void TriangleTree::findCut(Triangle* t, int depth, int maxDepth, double minArea, set<const Triangle*>& cut) const {
+	bool stop = t->isTerminal() || (maxDepth >= 0 && depth >= maxDepth);
+	const vector<Triangle*>& children = t->getChildren();
+	for (vector<Triangle*>::const_iterator it = children.begin(); it != children.end() && !stop; it++) {
+		stop = (*it)->getArea() < minArea;
+	}
+	if (stop) {
+		cut.insert(t);
+		return;
+	}
+	for (vector<Triangle*>::const_iterator it = children.begin(); it != children.end(); it++) {
+		findCut(*it, depth + 1, maxDepth, minArea, cut);
+	}
+}
+
+// Puts back the tree as it was encoded
+void TriangleTree::clearDetailLimit() {
+	for (vector<Triangle*>::const_iterator it = detailTriangles.begin(); it != detailTriangles.end(); it++) {
+		if (!(*it)->isTerminal()) {
+			(*it)->setTarget(TriFit());
+		}
+	}
+	detailTriangles.clear();
+	hasDetailLimit = false;
+}
+
+// The triangles that are decoded as terminal, which are the ones the tree
+// is cut at if it has a detail limit, in the order they appear in the tree
+vector<Triangle*> TriangleTree::getLeaves() const {
+	return hasDetailLimit?detailTriangles:getTerminals();
+}
+
+// Limits decoding to the terminal triangles the pixels in region depend on:
+// the ones covering it, the ones covering their domains, and so on. Areas
+// are looked up with margins of marginX and marginY around them, which
+// should be a few pixels so that the triangles around the edges and the
+// neighbours of filled in error pixels are included too.
+void TriangleTree::setDecodeRegion(const Rectangle& region, double marginX, double marginY) {
+	const TriangleIndex index(getLeaves());
+	vector<bool> needed(index.getSize(), false);
+	set<const Triangle*> domains;
+	vector<Rectangle> areas(1, region.expand(marginX, marginY));
+	while (!areas.empty()) {
+		const Rectangle area = areas.back();
+		areas.pop_back();
+		const vector<size_t> found = index.find(area);
+		for (vector<size_t>::const_iterator it = found.begin(); it != found.end(); it++) {
+			if (needed[*it]) {
+				continue;
+			}
+			needed[*it] = true;
+			const Triangle* domain = index.getTriangle(*it)->getTarget().best;
+			if (domain != NULL && domains.insert(domain).second) {
+				areas.push_back(domain->getBoundingBox().expand(marginX, marginY));
+			}
+		}
+	}
+
+	regionTriangles.clear();
+	for (size_t i = 0; i < index.getSize(); i++) {
+		if (needed[i]) {
+			regionTriangles.push_back(index.getTriangle(i));
+		}
+	}
+	hasRegion = true;
+	if (outputVerbose()) {
+		output << "Channel " << channelToString(channel) << " needs " << regionTriangles.size() << " of " <<
+		          index.getSize() << " triangles." << endl;
+	}
+}
+
+void TriangleTree::clearDecodeRegion() {
+	hasRegion = false;
+	regionTriangles.clear();
+}
+
+// The triangles a decode maps, in the order they appear in the tree
+vector<Triangle*> TriangleTree::getDecodeTriangles() const {
+	return hasRegion?regionTriangles:getLeaves();
+}
+
+void TriangleTree::renderTo(gdImagePtr image, bool fixErrors) {
+	if (outputVerbose()) {
+		output << "Rendering channel " << channelToString(channel) << "..." << endl;
+	}
+	AccumulationBuffer buffer(gdImageSX(image), gdImageSY(image), getNumComponents(channel));
+	const vector<Triangle*> triangles = getDecodeTriangles();
+	for (vector<Triangle*>::const_iterator it = triangles.begin(); it != triangles.end(); it++) {
+		this->image.mapPoints(*it, (*it)->getTarget(), buffer, channel);
 	}
+	buffer.normalize();
 
 	if (fixErrors) {
-		interpolateErrors(image, channel);
+		buffer.interpolateErrors();
 	}
 
-	clearAlpha(image);
+	buffer.writeTo(image, channel);
 }
 
 const DoubleImage& TriangleTree::getImage() const {
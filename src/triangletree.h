@@ -21,6 +21,10 @@
 #define _TRIANGLETREE_H
 
 #include <deque>
+#include <set>
+#include <vector>
+#include <string>
+#include <queue>
 #include <iterator>
 #include <cstddef>
 #include <ostream>
@@ -31,6 +35,8 @@
 #include "triangle.h"
 #include "doubleimage.h"
 #include "imageutils.h"
+#include "fitcache.h"
+#include "rectangle.h"
 
 class TriangleTree {
 public:
@@ -38,17 +44,58 @@ public:
 		M_QUAD,
 		M_CENTEROID
 	};
+	enum SubdivisionOrder {
+		O_BREADTHFIRST,
+		O_BESTFIRST
+	};
 private:
+	// Entry in the best-first queue, ordered so that the triangle whose
+	// fit contributes the most error is on top.
+	struct QueuedTriangle {
+		double priority;
+		Triangle* triangle;
+		QueuedTriangle(double priority, Triangle* triangle);
+		bool operator<(const QueuedTriangle& other) const;
+	};
+
 	Channel channel;
 	DoubleImage& image;
 	std::deque<Triangle*> unassigned;
+	std::priority_queue<QueuedTriangle> worst;
 	std::vector<Triangle*> allTriangles;
-	unsigned short lastId;
+	unsigned int lastId;
 
 	SubdivisionMethod sMethod;
+	SubdivisionOrder sOrder;
+	std::size_t maxTriangles;
+	std::size_t maxBytes;
+	// Kept for both id sizes so the switch past 65535 triangles is free
+	std::size_t serializedSize;
+	std::size_t longSerializedSize;
+	FitCache* fitCache;
+	// The terminal triangles decoding is limited to, if hasRegion
+	bool hasRegion;
+	std::vector<Triangle*> regionTriangles;
+	// The triangles the tree is cut at if hasDetailLimit
+	bool hasDetailLimit;
+	std::vector<Triangle*> detailTriangles;
+
+	void addSerializedSize(const Triangle* t);
+	void removeSerializedSize(const Triangle* t);
+	void resetSerializedSize();
+	std::size_t getSerializedSize(unsigned char idSize) const;
+	static unsigned char getIdSize(std::size_t numTriangles);
 
+	TriFit findBestMatch(const Triangle* t, const std::list<Triangle*>& above);
 	void subdivide(Triangle* t);
+	bool withinBudget(const Triangle* t) const;
+	bool isGoodEnough(const Triangle* t, const TriFit& fit, double cutoff);
+	Triangle* assignBreadthFirst(double cutoff);
+	Triangle* assignBestFirst(double cutoff);
 	void unserialize(std::istream& in);
+	void findCut(Triangle* t, int depth, int maxDepth, double minArea, std::set<const Triangle*>& cut) const;
+	TriFit getFlatFit(Triangle* t);
+	static void getNearest(const Triangle* t, std::list<Triangle*>& candidates, std::size_t count);
 public:
 	TriangleTree(DoubleImage& image, Channel channel);
 	TriangleTree(const TriangleTree& tree);
@@ -60,17 +107,41 @@ public:
 	const std::vector<Triangle*>& getAllTriangles() const;
 	SubdivisionMethod getSubdivisionMethod() const;
 	void setSubdivisionMethod(SubdivisionMethod sMethod);
+	SubdivisionOrder getSubdivisionOrder() const;
+	void setSubdivisionOrder(SubdivisionOrder sOrder);
+	std::size_t getMaxTriangles() const;
+	void setMaxTriangles(std::size_t maxTriangles);
+	std::size_t getMaxBytes() const;
+	void setMaxBytes(std::size_t maxBytes);
+	std::size_t getSerializedSize() const;
+	FitCache* getFitCache() const;
+	void setFitCache(FitCache* fitCache);
 
 	Triangle* assignOne(double cutoff);
+	bool inherit(const TriangleTree& previous, double cutoff);
 	static void getAllAbove(Triangle* t, std::insert_iterator<std::list<Triangle*> >& it);
 	static void getAllBelow(Triangle* t, std::insert_iterator<std::list<Triangle*> >& it);
 	static void getAllSiblings(Triangle* t, std::insert_iterator<std::list<Triangle*> >& it);
 	static void getAllNextSiblings(Triangle* t, std::insert_iterator<std::list<Triangle*> >& it);
 	static void getAllPrevSiblings(Triangle* t, std::insert_iterator<std::list<Triangle*> >& it);
-	unsigned short getLastId();
+	unsigned int getLastId();
+	unsigned char getIdSize() const;
 	void serialize(std::ostream& out) const;
-	static void serializeTree(std::ostream& out, const Triangle* t);
-	static void serializeChildren(std::ostream& out, const Triangle* t);
+	void getRecords(std::vector<std::string>& records) const;
+	void saveState(std::ostream& out) const;
+	void loadState(std::istream& in);
+	static void serializeTree(std::ostream& out, const Triangle* t, unsigned char components = 1,
+	                          unsigned char idSize = Triangle::SHORT_IDS);
+	static void serializeChildren(std::ostream& out, const Triangle* t, unsigned char components = 1,
+	                              unsigned char idSize = Triangle::SHORT_IDS);
+	std::vector<Triangle*> getTerminals() const;
+	double getSmallestCut(int maxDepth, double minArea) const;
+	void setDetailLimit(int maxDepth, double minArea);
+	void clearDetailLimit();
+	std::vector<Triangle*> getLeaves() const;
+	void setDecodeRegion(const Rectangle& region, double marginX, double marginY);
+	void clearDecodeRegion();
+	std::vector<Triangle*> getDecodeTriangles() const;
 	void renderTo(gdImagePtr image, bool fixErrors);
 	const DoubleImage& getImage() const;
 };
@@ -27,12 +27,26 @@
 using namespace std;
 
 TriFit::TriFit(double saturation, double brightness, double error, TriFit::PointMap pMap, const Triangle* best) :
-saturation(saturation), brightness(brightness), error(error), pMap(pMap), best(best) { }
+error(error), pMap(pMap), best(best) {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		this->saturation[i] = saturation;
+		this->brightness[i] = brightness;
+	}
+}
 
-TriFit::TriFit(const TriFit& other) : saturation(other.saturation), brightness(other.brightness), error(other.error),
-pMap(other.pMap), best(other.best) { }
+TriFit::TriFit(const TriFit& other) : error(other.error), pMap(other.pMap), best(other.best) {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		saturation[i] = other.saturation[i];
+		brightness[i] = other.brightness[i];
+	}
+}
 
-TriFit::TriFit() : saturation(0), brightness(0), error(-1), pMap(P000), best(NULL) { }
+TriFit::TriFit() : error(-1), pMap(P000), best(NULL) {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		saturation[i] = 0;
+		brightness[i] = 0;
+	}
+}
 
 char TriFit::pointMapToInt(TriFit::PointMap pMap) {
 	switch(pMap) {
@@ -150,8 +164,10 @@ unsigned char TriFit::getPoint2(PointMap pointMap) {
 
 TriFit& TriFit::operator=(const TriFit& other) {
 	if (this != &other) {
-		saturation = other.saturation;
-		brightness = other.brightness;
+		for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+			saturation[i] = other.saturation[i];
+			brightness[i] = other.brightness[i];
+		}
 		error = other.error;
 		best = other.best;
 		pMap = other.pMap;
@@ -161,7 +177,7 @@ TriFit& TriFit::operator=(const TriFit& other) {
 
 string TriFit::str() const {
 	ostringstream st;
-	st << "[s:" << saturation << ",o:" << brightness;
+	st << "[s:" << saturation[0] << ",o:" << brightness[0];
 	st << ",r:" << error << ",p:";
 	switch (pMap) {
 	case P012:
@@ -190,24 +206,54 @@ string TriFit::str() const {
 	return st.str();
 }
 
-void TriFit::serialize(ostream& out) const {
-	serializeFraction(out, saturation, 0, 1);
-	serializeFraction(out, brightness, -255, +255);
+void TriFit::serialize(ostream& out, unsigned char components, unsigned char idSize) const {
+	for (unsigned char i = 0; i < components; i++) {
+		serializeFraction(out, saturation[i], 0, 1);
+		serializeFraction(out, brightness[i], -255, +255);
+	}
 	serializeFraction(out, error, 0, 255);
 	out.put(pointMapToInt(pMap));
-	if (best != NULL) {
-		best->serializeID(out);
-	} else {
-		serializeUnsignedShort(out, 0xFFFF);
-	}
+	Triangle::serializeID(out, best, idSize);
 }
 
 
-TriFit::TriFit(istream& in, unsigned short* t) {
-	saturation = unserializeFraction(in, 0, 1);
-	brightness = unserializeFraction(in, -255, +255);
+// Must be kept in sync with serialize()
+size_t TriFit::getSerializedSize(unsigned char components, unsigned char idSize) {
+	return components * 2 * 4 + 4 + 1 + idSize;
+}
+
+TriFit::TriFit(istream& in, unsigned int* t, unsigned char components, unsigned char idSize) {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		if (i < components) {
+			saturation[i] = unserializeFraction(in, 0, 1);
+			brightness[i] = unserializeFraction(in, -255, +255);
+		} else {
+			saturation[i] = 0;
+			brightness[i] = 0;
+		}
+	}
 	error = unserializeFraction(in, 0, +255);
 	pMap = pointMapFromInt(in.get());
-	*t = unserializeUnsignedShort(in);
+	*t = Triangle::unserializeID(in, idSize);
+	best = NULL;
+}
+
+// Full precision copy of everything but best, which the caller handles
+void TriFit::saveState(ostream& out) const {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		serializeDouble(out, saturation[i]);
+		serializeDouble(out, brightness[i]);
+	}
+	serializeDouble(out, error);
+	out.put(pointMapToInt(pMap));
+}
+
+void TriFit::loadState(istream& in) {
+	for (unsigned char i = 0; i < MAX_COMPONENTS; i++) {
+		saturation[i] = unserializeDouble(in);
+		brightness[i] = unserializeDouble(in);
+	}
+	error = unserializeDouble(in);
+	pMap = pointMapFromInt(in.get());
 	best = NULL;
 }
@@ -31,23 +31,30 @@ public:
 		P012, P021, P102, P120, P201, P210, P000
 	};
 	static const unsigned char NUM_MAPS = 6;
+	// Shared geometry colour fits carry one intensity map per component
+	static const unsigned char MAX_COMPONENTS = 3;
 
-	double saturation;
-	double brightness;
+	double saturation[MAX_COMPONENTS];
+	double brightness[MAX_COMPONENTS];
 	double error;
 	PointMap pMap;
 	const class Triangle* best;
 
 	TriFit(double saturation, double brightness, double error, PointMap pMap, const class Triangle* best);
 	TriFit(const TriFit& other);
-	TriFit(std::istream& in, unsigned short* t);
+	// The id size always comes from the Triangle being read or written, see
+	// Triangle::SHORT_IDS
+	TriFit(std::istream& in, unsigned int* t, unsigned char components, unsigned char idSize);
 	explicit TriFit();
 
 	TriFit& operator=(const TriFit& other);
 
 
 	std::string str() const;
-	void serialize(std::ostream& out) const;
+	void serialize(std::ostream& out, unsigned char components, unsigned char idSize) const;
+	static std::size_t getSerializedSize(unsigned char components, unsigned char idSize);
+	void saveState(std::ostream& out) const;
+	void loadState(std::istream& in);
 
 	static PointMap pointMapFromInt(std::size_t pMap);
 	static char pointMapToInt(PointMap pMap);